@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
@@ -10,6 +11,7 @@
 #include <fcntl.h>
 #include <poll.h>
 #include <drm_mode.h>
+#include <linux/udmabuf.h>
 #include <libdrm/drm_fourcc.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
@@ -73,10 +75,75 @@ void bo_destroy(int fd, struct drm_bo *bo)
 
     if (bo->handle)
         drmIoctl(fd, DRM_IOCTL_MODE_DESTROY_DUMB, &arg);
+    if (bo->buf_fd > 0)
+        close(bo->buf_fd);
 
     free(bo);
 }
 
+/*
+ * Without a DRM card the buffer is a sealed memfd exported through
+ * /dev/udmabuf, with the same buf_fd/ptr/pitch as a dumb buffer.
+ */
+static struct drm_bo *
+bo_create_udmabuf(int width, int height, int format)
+{
+    struct udmabuf_create arg;
+    struct drm_bo *bo;
+    long page = sysconf(_SC_PAGESIZE);
+    int bpp = format == DRM_FORMAT_NV12 ? 8 : 32;
+    int rows = format == DRM_FORMAT_NV12 ? height * 3 / 2 : height;
+    int memfd, dev;
+
+    bo = malloc(sizeof(struct drm_bo));
+    if (bo == NULL) {
+        fprintf(stderr, "allocate bo failed\n");
+        return NULL;
+    }
+    memset(bo, 0, sizeof(*bo));
+    bo->fd = -1;
+    bo->pitch = (width * bpp / 8 + 63) & ~63;
+    bo->size = ((size_t)bo->pitch * rows + page - 1) & ~(page - 1);
+    bo->w = width;
+    bo->h = height;
+
+    dev = open("/dev/udmabuf", O_RDWR | O_CLOEXEC);
+    memfd = memfd_create("bo", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (dev < 0 || memfd < 0 || ftruncate(memfd, bo->size) < 0 ||
+        fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK) < 0) {
+        fprintf(stderr, "udmabuf setup failed\n");
+        goto err;
+    }
+
+    memset(&arg, 0, sizeof(arg));
+    arg.memfd = memfd;
+    arg.flags = UDMABUF_FLAGS_CLOEXEC;
+    arg.size = bo->size;
+    bo->buf_fd = ioctl(dev, UDMABUF_CREATE, &arg);
+    if (bo->buf_fd < 0) {
+        fprintf(stderr, "create udmabuf failed\n");
+        bo->buf_fd = 0;
+        goto err;
+    }
+
+    bo->ptr = mmap(0, bo->size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (bo->ptr == MAP_FAILED) {
+        bo->ptr = NULL;
+        fprintf(stderr, "map bo failed\n");
+        goto err;
+    }
+    close(memfd);
+    close(dev);
+    return bo;
+err:
+    if (memfd >= 0)
+        close(memfd);
+    if (dev >= 0)
+        close(dev);
+    bo_destroy(-1, bo);
+    return NULL;
+}
+
 static struct drm_bo *
 bo_create(int fd, int width, int height, int format)
 {
@@ -88,6 +155,9 @@ bo_create(int fd, int width, int height, int format)
     struct drm_bo *bo;
     int ret;
 
+    if (fd < 0)
+        return bo_create_udmabuf(width, height, format);
+
     bo = malloc(sizeof(struct drm_bo));
     if (bo == NULL) {
         fprintf(stderr, "allocate bo failed\n");
@@ -133,8 +203,8 @@ static int mdrm_init(void)
     if (fd < 0)
         fd = open("/dev/dri/card0", O_RDWR);
     if (fd < 0) {
-        fprintf(stderr, "drm open failed\n");
-        return 0;
+        fprintf(stderr, "drm open failed, using udmabuf\n");
+        return -1;
     }
     fcntl(fd, F_SETFD, FD_CLOEXEC);
 
@@ -160,25 +230,32 @@ int main(int argc, char *argv[])
     ectx = ectx_create_window(ow, oh);
 
     drm_fd = mdrm_init();
-    in_bo = bo_create(drm_fd, w, h, DRM_FORMAT_BGRA8888);
-    out_bo = bo_create(drm_fd, ow, oh, DRM_FORMAT_BGRA8888);
+    // the file holds B,G,R,A bytes, which is DRM ARGB8888 (little endian)
+    in_bo = bo_create(drm_fd, w, h, DRM_FORMAT_ARGB8888);
+    out_bo = bo_create(drm_fd, ow, oh, DRM_FORMAT_ARGB8888);
+    if (!in_bo || !out_bo)
+        return -1;
 
     fd = fopen(argv[1],"rb");
     if (!fd)
         return -1;
+    ectx_begin_cpu_access(in_bo->buf_fd, ECTX_CPU_WRITE);
     fread(in_bo->ptr, 1, in_bo->size, fd);
+    ectx_end_cpu_access(in_bo->buf_fd, ECTX_CPU_WRITE);
     fclose(fd);
 
     ectx_import_output(ectx, out_bo->buf_fd, ow, oh,
-                       out_bo->pitch, DRM_FORMAT_BGRA8888);
+                       out_bo->pitch, DRM_FORMAT_ARGB8888);
     ectx_activation_texture(ectx, in_bo->buf_fd, w, h,
-                            in_bo->pitch, DRM_FORMAT_BGRA8888);
+                            in_bo->pitch, DRM_FORMAT_ARGB8888);
     ectx_render(ectx, ow, oh, 90);
 
     fd = fopen(argv[2], "wb+");
     if (!fd)
         return -1;
+    ectx_begin_cpu_access(out_bo->buf_fd, ECTX_CPU_READ);
     fwrite(out_bo->ptr, ow * oh * 4, 1, fd);
+    ectx_end_cpu_access(out_bo->buf_fd, ECTX_CPU_READ);
     fclose(fd);
 
     return 0;
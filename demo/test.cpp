@@ -9,20 +9,25 @@
 
 int main() {
 	printf("anner test begin\n");
-	FILE *fp;
-	int size_file = 1280*720*4;
-	unsigned char pixels[1280*720*4];
-	fp = fopen("/home/linaro/bgra-1280-720.bin","rt");
-	printf("textures size:%d\n",size_file);
-	fread(pixels, 1, size_file, fp);
-	fclose(fp);
+	// BGRA byte order is DRM ARGB8888; the file is mapped, not read onto the stack
+	void* frames = anner_open_frames("/home/linaro/bgra-1280-720.bin", 1280, 720, DRM_FORMAT_ARGB8888, 0, 30);
+	if (!frames) {
+		printf("open file is err\n");
+		return -1;
+	}
+	printf("frames:%d\n", anner_frame_count(frames));
 	anner_create_window(1280,720);
+	// two workers keep four frames loaded ahead of the render loop
+	void* loader = anner_start_loader(frames, 2, 4);
 	bool quit = false;
 	while ( !quit ) {
-		anner_create_texture(pixels, 1280, 720, 0x80E1);
+		// uploads into the texture of the previous frame, storage is only allocated once
+		anner_upload_loaded(loader, -1);
 		anner_render(1280, 720);
-		anner_delete_texture();
 	}
+	anner_stop_loader(loader);
+	anner_delete_texture();
+	anner_close_frames(frames);
 	anner_destory_window();
 	printf("anner test end\n");
 	return 0;
@@ -1,18 +1,130 @@
+#ifndef __ANNER_H__
+#define __ANNER_H__
+
+#include <stdint.h>
 #include <libdrm/drm_fourcc.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 
 void anner_create_window(int window_width, int window_height);
+//Upload a frame; the texture is reused while size and format stay the same, delete it once at the end
 int anner_create_texture(unsigned char* pixels, int w, int h, int format);
+//Same upload without the copy: fill the returned buffer (from any thread), then commit on the render thread
+unsigned char* anner_map_texture(int w, int h, int format);
+int anner_commit_texture(void);
+//Upload only the 64x64 tiles that changed since the previous call and present them as damage
+int anner_update_texture(unsigned char* pixels, int w, int h, int format);
 int anner_delete_texture(void);
+//Skip upload and draw of frames whose content (hash) and effects repeat the last frame, off by default.
+//anner_render/anner_render_async still wait for/fence the earlier render of the repeated frame
+void anner_set_dedup(int enable);
+uint64_t anner_get_skipped_frames(void);
+//Raw frame file (BGRA, NV12, YUYV... dumps, format is a DRM fourcc) mapped read-only, frames are
+//views into the mapping valid until close. stride <= 0 for packed rows, fps 0 for no pacing.
+//Y4M and indexed captures describe themselves, w/h/format/stride are ignored and fps 0 takes theirs
+void* anner_open_frames(const char *path, int w, int h, int format, int stride, int fps);
+int anner_frame_count(void* frames);
+const unsigned char* anner_get_frame(void* frames, int index);
+//Waits until the next frame is due, loops at the end of the file
+const unsigned char* anner_next_frame(void* frames, int *index);
+//Capture time in ns of an indexed capture's frame, else index / fps; -1 if unknown
+int64_t anner_frame_timestamp(void* frames, int index);
+void anner_close_frames(void* frames);
+//Window backends: upload frame index (packed RGB formats only) as anner_create_texture() does
+int anner_upload_frame(void* frames, int index);
+//Worker threads (<= 4) loading the next frames into count (<= 8) staging buffers ahead of the
+//render thread; frames come out in order at the source's frame rate. Every backend
+void* anner_start_loader(void* frames, int threads, int count);
+void anner_stop_loader(void* loader);
+//Window backends: upload the next loaded frame, returns its index, -1 on timeout (timeout_ms < 0 waits)
+int anner_upload_loaded(void* loader, int timeout_ms);
 void anner_destory_window(void);
 void anner_render(int w, int h);
 int anner_dumpPixels(int len, int inWindowWidth, int inWindowHeight, unsigned char * pPixelDataFront, char* file_name);
+//Non-blocking anner_dumpPixels (offscreen backend): queues a readback of the current output into
+//file_name while the next frame renders, a writer thread writes the files in order
+int anner_dump_pixels_async(int w, int h, const char* file_name);
+//Wait until every queued dump is written, -1 if one failed since the last flush
+int anner_dump_flush(void);
+//Capture sink: frames of frame_size bytes appended to one file preallocated for frames_hint frames,
+//written with O_DIRECT by a thread through chunks (2..32, at least frame_size / 4 MB + 2) 4 MB buffers. Every backend
+void* anner_open_capture(const char *path, int frame_size, int frames_hint, int chunks);
+//Same sink writing a self-describing file: Y4M (YUV420/NV12 frames, NV12 stored as I420) or an
+//indexed raw container keeping format, stride and per-frame offsets and timestamps; anner_open_frames
+//reads both back without being told the layout. stride is the pitch the frames are handed in with
+#define ANNER_CONTAINER_RAW     0
+#define ANNER_CONTAINER_Y4M     1
+#define ANNER_CONTAINER_INDEXED 2
+void* anner_open_capture_container(const char *path, int container, int w, int h, int format,
+                                   int stride, int fps, int frames_hint, int chunks);
+//0 queued, 1 dropped because storage can not keep up (counted), -1 on bad arguments
+int anner_capture_append(void* capture, const void* pixels);
+uint64_t anner_capture_dropped(void* capture);
+//Writes the queued frames and trims the file, -1 if a write failed
+int anner_close_capture(void* capture);
+//Offscreen backend: append the mapped output buffer, with the CPU access bracket
+int anner_capture_output(void* capture, void* pixels, int drmbuf_fd);
 
 //Off-screen rendering dummy function
 int anner_create_intput(void** pixels, int *drmbuf_fd, int w, int h, int format, int stride);
+//returns the output id, the new output becomes the render target
 int anner_create_output(void** pixels, int *drmbuf_fd, int w, int h, int format, int stride);
+int anner_select_output(int output);
+//NV12 outputs: 0 = BT.601, 1 = BT.709 (limited range), BT.601 by default
+int anner_set_output_colorspace(int output, int colorspace);
 void anner_activation_texture(void* pixels, int drmbuf_fd, int w, int h, int format, int stride);
+//Copy frame index into the input buffer (stride is its row pitch) and activate it
+int anner_activate_frame(void* frames, int index, void* pixels, int drmbuf_fd, int stride);
+//Activate the next loaded frame from its own input buffer, returns its index, -1 on timeout.
+//The previous one is refilled from here on, wait for async renders of it first
+int anner_activate_loaded(void* loader, int timeout_ms);
 int anner_disable_texture();
+//len is ignored, the buffer goes back to the pool it came from
 int anner_delete_buf(void* pixels, int drm_fd, int len, int type);
-void anner_set_effects(int Angle);
\ No newline at end of file
+//Modifiers the GPU imports format with (render = as an output), linear always included
+int anner_query_modifiers(int format, int render, uint64_t *modifiers, int max);
+//Buffers in a layout both the GPU and the caller's modifiers (NULL = any) support, AFBC when possible.
+//stride and modifier return the layout picked, pixels is NULL unless it is linear
+int anner_create_intput_modifier(void** pixels, int *drmbuf_fd, int w, int h, int format,
+                                 const uint64_t *modifiers, int count, int *stride, uint64_t *modifier);
+int anner_create_output_modifier(void** pixels, int *drmbuf_fd, int w, int h, int format,
+                                 const uint64_t *modifiers, int count, int *stride, uint64_t *modifier);
+void anner_activation_texture_modifier(void* pixels, int drmbuf_fd, int w, int h, int format, int stride,
+                                       uint64_t modifier);
+//Bracket every CPU read/write of a buffer's pixels, flags are what the CPU does in between
+#define ANNER_CPU_READ  1
+#define ANNER_CPU_WRITE 2
+int anner_begin_cpu_access(int drmbuf_fd, int flags);
+int anner_end_cpu_access(int drmbuf_fd, int flags);
+//Process-wide memory held by the library, per category; imports and targets are views of
+//buffers and overlap with them. -1 for an unknown category. Dummy backend only, the window
+//backends do not account their textures and upload buffers
+#define ANNER_MEMORY_BUFFERS   0
+#define ANNER_MEMORY_IMPORTS   1
+#define ANNER_MEMORY_TARGETS   2
+#define ANNER_MEMORY_SCALERS   3
+#define ANNER_MEMORY_READBACKS 4
+int anner_get_memory_usage(int category, uint64_t *bytes, uint64_t *peak, int *count);
+//0 = unlimited. Over budget idle buffers and LRU imports are evicted, new buffers fail if that is not enough
+int anner_set_memory_budget(int category, uint64_t bytes);
+void anner_set_effects(int Angle);
+//angle in degrees, crop rectangle in input pixels (0 size = whole input), scale 1.0 = fit
+void anner_set_transform(float angle, int flip_h, int flip_v,
+                         int crop_x, int crop_y, int crop_w, int crop_h, float scale);
+//0 nearest (default), 1 bilinear, 2 bicubic, 3 Lanczos; large reductions go through box passes first
+void anner_set_scaler(int mode);
+//Ring of count outputs: anner_render_ring() renders into a free one while consumers still hold
+//earlier frames, anner_acquire_frame() hands finished frames out in render order until released
+int anner_create_output_ring(int count, int w, int h, int format, int stride);
+int anner_render_ring(int w, int h);    //slot rendered into, -1 if every output is queued or held
+int anner_acquire_frame(int timeout_ms, void** pixels, int *drmbuf_fd);    //slot, -1 on timeout
+void anner_release_frame(int slot);
+void anner_destroy_output_ring(void);
+//Asynchronous render, wait/poll return 0 when the frame is done, 1 on timeout, -1 on error
+void* anner_render_async(int w, int h);
+int anner_wait_fence(void* fence, int timeout_ms);
+int anner_poll_fence(void* fence);
+int anner_fence_fd(void* fence);
+void anner_destroy_fence(void* fence);
+
+#endif
@@ -4,4 +4,5 @@
 #include  <EGL/eglext.h>
 
 int egl_render(int w, int h);
-void shader_init(void);
\ No newline at end of file
+void shader_init(void);
+void shader_deinit(void);
\ No newline at end of file
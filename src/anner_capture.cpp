@@ -0,0 +1,478 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <libdrm/drm_fourcc.h>
+
+#include "anner_capture.h"
+
+/* Write len bytes at offset, the tail of the last chunk is padded to the alignment */
+static int chunk_write(struct anner_capture *capture, struct anner_capture_chunk *chunk) {
+    size_t len = capture->direct ? (chunk->used + ANNER_CAPTURE_ALIGN - 1) & ~(size_t)(ANNER_CAPTURE_ALIGN - 1)
+                                 : chunk->used;
+    size_t done = 0;
+    ssize_t ret;
+
+    memset(chunk->data + chunk->used, 0, len - chunk->used);
+    while (done < len) {
+        ret = pwrite(capture->fd, chunk->data + done, len - done, chunk->offset + done);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0) {
+            printf("anner_capture: write at %lld failed: %s\n",
+                   (long long)(chunk->offset + done), ret < 0 ? strerror(errno) : "no space");
+            return -1;
+        }
+        done += ret;
+    }
+    if (!capture->direct) {
+        // push the range out and drop it from the page cache, nobody reads it back
+        sync_file_range(capture->fd, chunk->offset, len,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(capture->fd, chunk->offset, len, POSIX_FADV_DONTNEED);
+    }
+    return 0;
+}
+
+static void *capture_writer(void *arg) {
+    struct anner_capture *capture = (struct anner_capture *)arg;
+    struct anner_capture_chunk *chunk;
+    int ret;
+
+    pthread_mutex_lock(&capture->lock);
+    for (;;) {
+        while (!capture->queue_count && !capture->stop)
+            pthread_cond_wait(&capture->changed, &capture->lock);
+        if (!capture->queue_count)
+            break;
+        chunk = &capture->chunks[capture->queue[capture->queue_head]];
+        pthread_mutex_unlock(&capture->lock);
+
+        ret = capture->error ? -1 : chunk_write(capture, chunk);
+
+        pthread_mutex_lock(&capture->lock);
+        if (ret < 0)
+            capture->error = 1;
+        else
+            capture->stats.bytes += chunk->used;
+        capture->queue_head = (capture->queue_head + 1) % ANNER_CAPTURE_CHUNKS_MAX;
+        capture->queue_count--;
+        chunk->state = ANNER_CAPTURE_FREE;
+        chunk->used = 0;
+        capture->free_count++;
+        pthread_cond_broadcast(&capture->changed);
+    }
+    pthread_mutex_unlock(&capture->lock);
+    return NULL;
+}
+
+static void capture_free(struct anner_capture *capture) {
+    for (int i = 0; i < capture->count; i++) {
+        free(capture->chunks[i].data);
+    }
+    if (capture->fd >= 0)
+        close(capture->fd);
+    free(capture->index);
+    free(capture->row);
+    memset(capture, 0, sizeof(*capture));
+    capture->fd = -1;
+}
+
+/*
+ * anner_capture_open() with extra bytes preallocated besides the frames,
+ * for the container header and index.
+ */
+static int capture_open(struct anner_capture *capture, const char *path, size_t frame_size,
+                        off_t extra, int frames_hint, int chunks) {
+    memset(capture, 0, sizeof(*capture));
+    capture->fd = -1;
+    capture->filling = -1;
+    if (!frame_size || chunks < 2 || chunks > ANNER_CAPTURE_CHUNKS_MAX) {
+        printf("anner_capture: %d chunks out of range 2..%d\n", chunks, ANNER_CAPTURE_CHUNKS_MAX);
+        return -1;
+    }
+    // a frame has to fit the free chunks next to a partly filled one, or it is never taken
+    if (chunks < (int)(frame_size / ANNER_CAPTURE_CHUNK) + 2) {
+        if (frame_size / ANNER_CAPTURE_CHUNK + 2 > ANNER_CAPTURE_CHUNKS_MAX) {
+            printf("anner_capture: frames of %zu bytes do not fit %d chunks\n",
+                   frame_size, ANNER_CAPTURE_CHUNKS_MAX);
+            return -1;
+        }
+        chunks = (int)(frame_size / ANNER_CAPTURE_CHUNK) + 2;
+    }
+
+    capture->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0644);
+    capture->direct = capture->fd >= 0;
+    // tmpfs and some network filesystems refuse O_DIRECT
+    if (capture->fd < 0 && errno == EINVAL)
+        capture->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (capture->fd < 0) {
+        printf("anner_capture: open %s failed: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (frames_hint > 0 &&
+        fallocate(capture->fd, 0, 0, extra + (off_t)frame_size * frames_hint) < 0)
+        printf("anner_capture: no preallocation for %s: %s\n", path, strerror(errno));
+
+    for (; capture->count < chunks; capture->count++) {
+        struct anner_capture_chunk *chunk = &capture->chunks[capture->count];
+
+        if (posix_memalign((void **)&chunk->data, ANNER_CAPTURE_ALIGN, ANNER_CAPTURE_CHUNK) != 0) {
+            chunk->data = NULL;
+            capture_free(capture);
+            return -1;
+        }
+    }
+    capture->free_count = capture->count;
+    capture->frame_size = frame_size;
+    clock_gettime(CLOCK_MONOTONIC, &capture->start);
+    pthread_mutex_init(&capture->lock, NULL);
+    pthread_cond_init(&capture->changed, NULL);
+    if (pthread_create(&capture->writer, NULL, capture_writer, capture) != 0) {
+        printf("anner_capture: failed to start the writer\n");
+        pthread_cond_destroy(&capture->changed);
+        pthread_mutex_destroy(&capture->lock);
+        capture_free(capture);
+        return -1;
+    }
+    printf("anner_capture: %s %s, %d chunks of %d bytes\n", path,
+           capture->direct ? "direct" : "buffered", chunks, ANNER_CAPTURE_CHUNK);
+    return 0;
+}
+
+int anner_capture_open(struct anner_capture *capture, const char *path, size_t frame_size,
+                       int frames_hint, int chunks) {
+    return capture_open(capture, path, frame_size, 0, frames_hint, chunks);
+}
+
+/* Hand the chunk being filled to the writer. Called with the lock held */
+static void chunk_queue(struct anner_capture *capture) {
+    struct anner_capture_chunk *chunk = &capture->chunks[capture->filling];
+
+    chunk->state = ANNER_CAPTURE_QUEUED;
+    chunk->offset = capture->offset;
+    capture->offset += ANNER_CAPTURE_CHUNK;
+    capture->queue[(capture->queue_head + capture->queue_count) % ANNER_CAPTURE_CHUNKS_MAX] =
+        capture->filling;
+    capture->queue_count++;
+    capture->filling = -1;
+    pthread_cond_broadcast(&capture->changed);
+}
+
+/* A FREE chunk made the one being filled, waits for the writer if there is none. Called with the lock held */
+static void chunk_take(struct anner_capture *capture) {
+    while (capture->filling < 0) {
+        for (int i = 0; i < capture->count; i++) {
+            if (capture->chunks[i].state == ANNER_CAPTURE_FREE) {
+                capture->chunks[i].state = ANNER_CAPTURE_FILLING;
+                capture->chunks[i].used = 0;
+                capture->free_count--;
+                capture->filling = i;
+                return;
+            }
+        }
+        pthread_cond_wait(&capture->changed, &capture->lock);
+    }
+}
+
+/*
+ * Append n bytes to the file. Called with the lock held; only the producer
+ * touches the chunk being filled, so the copy runs without it.
+ */
+static void stream_append(struct anner_capture *capture, const void *data, size_t n) {
+    const unsigned char *src = (const unsigned char *)data;
+
+    capture->appended += n;
+    while (n) {
+        struct anner_capture_chunk *chunk;
+        size_t len;
+
+        chunk_take(capture);
+        chunk = &capture->chunks[capture->filling];
+        pthread_mutex_unlock(&capture->lock);
+
+        len = ANNER_CAPTURE_CHUNK - chunk->used;
+        if (len > n)
+            len = n;
+        memcpy(chunk->data + chunk->used, src, len);
+        chunk->used += len;
+        src += len;
+        n -= len;
+
+        pthread_mutex_lock(&capture->lock);
+        if (chunk->used == ANNER_CAPTURE_CHUNK)
+            chunk_queue(capture);
+    }
+}
+
+/* One frame as Y4M: the frame marker and packed I420 planes. Called with the lock held */
+static void y4m_append(struct anner_capture *capture, const unsigned char *frame) {
+    const struct anner_format_layout *layout = &capture->layout;
+    int w = capture->header.w;
+    int cw = (w + 1) / 2;
+
+    stream_append(capture, ANNER_Y4M_FRAME, ANNER_Y4M_FRAME_LEN);
+    for (int y = 0; y < layout->heights[0]; y++) {
+        stream_append(capture, frame + layout->offsets[0] + (size_t)y * layout->pitches[0], w);
+    }
+    if (capture->header.fourcc == DRM_FORMAT_YUV420) {
+        for (int i = 1; i < 3; i++) {
+            for (int y = 0; y < layout->heights[i]; y++) {
+                stream_append(capture, frame + layout->offsets[i] + (size_t)y * layout->pitches[i], cw);
+            }
+        }
+        return;
+    }
+    // NV12 chroma is interleaved UV, Y4M wants the U plane and then the V plane
+    for (int c = 0; c < 2; c++) {
+        for (int y = 0; y < layout->heights[1]; y++) {
+            const unsigned char *uv = frame + layout->offsets[1] + (size_t)y * layout->pitches[1];
+
+            for (int x = 0; x < cw; x++) {
+                capture->row[x] = uv[2 * x + c];
+            }
+            stream_append(capture, capture->row, cw);
+        }
+    }
+}
+
+int anner_capture_open_container(struct anner_capture *capture, const char *path, int container,
+                                 int w, int h, uint32_t format, int stride, int fps,
+                                 int frames_hint, int chunks) {
+    static const unsigned char zeros[ANNER_CONTAINER_HEADER] = { 0 };
+    struct anner_container_header header;
+    struct anner_format_layout layout;
+    struct anner_format_layout packed;
+    char y4m[ANNER_Y4M_HEADER_MAX];
+    size_t frame_size;
+    off_t extra;
+    int len = 0;
+
+    if (anner_format_layout(format, w, h, stride, &layout) < 0) {
+        printf("anner_capture: unsupported format 0x%x\n", format);
+        return -1;
+    }
+    switch (container) {
+    case ANNER_CONTAINER_RAW:
+        return anner_capture_open(capture, path, layout.size, frames_hint, chunks);
+    case ANNER_CONTAINER_Y4M:
+        if (!anner_container_y4m_supported(format)) {
+            printf("anner_capture: format 0x%x does not go into Y4M\n", format);
+            return -1;
+        }
+        len = anner_container_y4m_header(y4m, sizeof(y4m), w, h, fps);
+        if (anner_container_y4m_layout(w, h, &packed) < 0)
+            return -1;
+        frame_size = ANNER_Y4M_FRAME_LEN + packed.size;
+        extra = len;
+        break;
+    case ANNER_CONTAINER_INDEXED:
+        frame_size = layout.size;
+        extra = ANNER_CONTAINER_HEADER;
+        if (frames_hint > 0)
+            extra += (off_t)sizeof(struct anner_container_entry) * frames_hint;
+        break;
+    default:
+        printf("anner_capture: unknown container %d\n", container);
+        return -1;
+    }
+    if (len < 0 || capture_open(capture, path, frame_size, extra, frames_hint, chunks) < 0)
+        return -1;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ANNER_CONTAINER_MAGIC, sizeof(header.magic));
+    header.version = ANNER_CONTAINER_VERSION;
+    header.fourcc = format;
+    header.modifier = DRM_FORMAT_MOD_LINEAR;
+    header.w = w;
+    header.h = h;
+    header.stride = layout.pitches[0];
+    header.fps = fps > 0 ? fps : 0;
+    header.frame_size = layout.size;
+    capture->container = container;
+    capture->header = header;
+    capture->layout = layout;
+    if (container == ANNER_CONTAINER_Y4M && format == DRM_FORMAT_NV12) {
+        capture->row = (unsigned char *)malloc((w + 1) / 2);
+        if (!capture->row) {
+            anner_capture_close(capture);
+            return -1;
+        }
+    }
+
+    pthread_mutex_lock(&capture->lock);
+    if (container == ANNER_CONTAINER_Y4M) {
+        stream_append(capture, y4m, len);
+    } else {
+        // no index yet, close rewrites the header with its position
+        stream_append(capture, &header, sizeof(header));
+        stream_append(capture, zeros, ANNER_CONTAINER_HEADER - sizeof(header));
+    }
+    pthread_mutex_unlock(&capture->lock);
+    return 0;
+}
+
+/* Remember where the next frame starts and when it came in. -1 if the index can not grow */
+static int index_add(struct anner_capture *capture) {
+    struct anner_container_entry *entry;
+    struct timespec now;
+
+    if (capture->index_count == capture->index_capacity) {
+        size_t capacity = capture->index_capacity ? capture->index_capacity * 2 : 1024;
+        struct anner_container_entry *index = (struct anner_container_entry *)
+            realloc(capture->index, capacity * sizeof(*index));
+
+        if (!index)
+            return -1;
+        capture->index = index;
+        capture->index_capacity = capacity;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    entry = &capture->index[capture->index_count++];
+    entry->offset = capture->appended;
+    entry->timestamp_ns = (uint64_t)(now.tv_sec - capture->start.tv_sec) * 1000000000ull +
+                          now.tv_nsec - capture->start.tv_nsec;
+    return 0;
+}
+
+int anner_capture_frame(struct anner_capture *capture, const void *frame) {
+    size_t room;
+
+    pthread_mutex_lock(&capture->lock);
+    room = (size_t)capture->free_count * ANNER_CAPTURE_CHUNK;
+    if (capture->filling >= 0)
+        room += ANNER_CAPTURE_CHUNK - capture->chunks[capture->filling].used;
+    if (capture->error || room < capture->frame_size ||
+        (capture->container == ANNER_CONTAINER_INDEXED && index_add(capture) < 0)) {
+        capture->stats.dropped++;
+        pthread_mutex_unlock(&capture->lock);
+        return 1;
+    }
+    capture->stats.frames++;
+
+    if (capture->container == ANNER_CONTAINER_Y4M)
+        y4m_append(capture, (const unsigned char *)frame);
+    else
+        stream_append(capture, frame, capture->frame_size);
+    pthread_mutex_unlock(&capture->lock);
+    return 0;
+}
+
+void anner_capture_get_stats(struct anner_capture *capture, struct anner_capture_stats *stats) {
+    pthread_mutex_lock(&capture->lock);
+    *stats = capture->stats;
+    pthread_mutex_unlock(&capture->lock);
+}
+
+/* Point the header of an indexed capture at its index, once everything else is written */
+static int header_rewrite(struct anner_capture *capture) {
+    void *block;
+    ssize_t ret;
+
+    // O_DIRECT wants an aligned buffer, the reserved header space is one aligned block
+    if (posix_memalign(&block, ANNER_CAPTURE_ALIGN, ANNER_CONTAINER_HEADER) != 0)
+        return -1;
+    memset(block, 0, ANNER_CONTAINER_HEADER);
+    memcpy(block, &capture->header, sizeof(capture->header));
+    do {
+        ret = pwrite(capture->fd, block, ANNER_CONTAINER_HEADER, 0);
+    } while (ret < 0 && errno == EINTR);
+    free(block);
+    if (ret != ANNER_CONTAINER_HEADER) {
+        printf("anner_capture: header update failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+int anner_capture_close(struct anner_capture *capture) {
+    off_t size;
+    int ret;
+
+    if (capture->fd < 0)
+        return -1;
+    pthread_mutex_lock(&capture->lock);
+    if (capture->container == ANNER_CONTAINER_INDEXED) {
+        capture->header.frames = capture->index_count;
+        capture->header.index_offset = capture->appended;
+        stream_append(capture, capture->index, capture->index_count * sizeof(*capture->index));
+    }
+    size = capture->appended;
+    if (capture->filling >= 0)
+        chunk_queue(capture);
+    capture->stop = 1;
+    pthread_cond_broadcast(&capture->changed);
+    pthread_mutex_unlock(&capture->lock);
+    pthread_join(capture->writer, NULL);
+
+    ret = capture->error ? -1 : 0;
+    // drop the padding of the last chunk and the unused preallocation
+    if (!capture->error && ftruncate(capture->fd, size) < 0)
+        ret = -1;
+    if (!capture->error && capture->container == ANNER_CONTAINER_INDEXED && header_rewrite(capture) < 0)
+        ret = -1;
+    printf("anner_capture: %llu frames, %llu dropped\n",
+           (unsigned long long)capture->stats.frames, (unsigned long long)capture->stats.dropped);
+    pthread_cond_destroy(&capture->changed);
+    pthread_mutex_destroy(&capture->lock);
+    capture_free(capture);
+    return ret;
+}
+
+/* Capture API of include/anner.h (C++ linkage, as declared there), the same for every backend */
+
+void* anner_open_capture(const char *path, int frame_size, int frames_hint, int chunks) {
+    struct anner_capture *capture = (struct anner_capture *)malloc(sizeof(*capture));
+
+    if (!capture || frame_size <= 0)
+        goto fail;
+    if (anner_capture_open(capture, path, (size_t)frame_size, frames_hint, chunks) < 0)
+        goto fail;
+    return capture;
+
+fail:
+    free(capture);
+    return NULL;
+}
+
+int anner_capture_append(void* capture, const void* pixels) {
+    if (!capture || !pixels)
+        return -1;
+    return anner_capture_frame((struct anner_capture *)capture, pixels);
+}
+
+void* anner_open_capture_container(const char *path, int container, int w, int h, int format,
+                                   int stride, int fps, int frames_hint, int chunks) {
+    struct anner_capture *capture = (struct anner_capture *)malloc(sizeof(*capture));
+
+    if (!capture)
+        return NULL;
+    if (anner_capture_open_container(capture, path, container, w, h, (uint32_t)format, stride, fps,
+                                     frames_hint, chunks) < 0) {
+        free(capture);
+        return NULL;
+    }
+    return capture;
+}
+
+uint64_t anner_capture_dropped(void* capture) {
+    struct anner_capture_stats stats;
+
+    if (!capture)
+        return 0;
+    anner_capture_get_stats((struct anner_capture *)capture, &stats);
+    return stats.dropped;
+}
+
+int anner_close_capture(void* capture) {
+    int ret;
+
+    if (!capture)
+        return -1;
+    ret = anner_capture_close((struct anner_capture *)capture);
+    free(capture);
+    return ret;
+}
@@ -0,0 +1,122 @@
+#ifndef __ANNER_CAPTURE_H__
+#define __ANNER_CAPTURE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "anner_container.h"
+#include "anner_format.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Capture sink for long raw frame sequences.
+ *
+ * Frames are appended back to back to one preallocated file instead of a
+ * file per frame. The producer copies each frame into aligned chunk
+ * buffers; full chunks go through a bounded queue to a writer thread that
+ * writes them with O_DIRECT, so hours of output neither open files per
+ * frame nor fill the page cache. On filesystems without O_DIRECT the file
+ * is written buffered and written ranges are dropped from the cache.
+ *
+ * The producer never waits for storage: a frame that does not fit into
+ * the free chunks is dropped whole and counted, so the sequence on disk
+ * only ever holds complete frames.
+ *
+ * The file is bare frames, or one of the anner_container formats so
+ * tools and anner_source do not have to be told the frame layout.
+ */
+
+#define ANNER_CAPTURE_CHUNK      (4 << 20)
+#define ANNER_CAPTURE_ALIGN      4096
+#define ANNER_CAPTURE_CHUNKS_MAX 32
+
+enum anner_capture_state {
+    ANNER_CAPTURE_FREE = 0,
+    ANNER_CAPTURE_FILLING,
+    ANNER_CAPTURE_QUEUED,
+};
+
+struct anner_capture_chunk {
+    unsigned char *data;    // ANNER_CAPTURE_ALIGN aligned, ANNER_CAPTURE_CHUNK bytes
+    int state;
+    size_t used;
+    off_t offset;           // file offset the chunk is written to
+};
+
+struct anner_capture_stats {
+    uint64_t frames;        // frames accepted
+    uint64_t dropped;       // frames dropped because the queue was full or a write failed
+    uint64_t bytes;         // bytes written to the file
+};
+
+struct anner_capture {
+    int fd;
+    int direct;             // opened with O_DIRECT
+    size_t frame_size;
+    int count;
+    struct anner_capture_chunk chunks[ANNER_CAPTURE_CHUNKS_MAX];
+    int filling;            // chunk the producer copies into, -1 if none
+    off_t offset;           // file offset of the next chunk
+    int queue[ANNER_CAPTURE_CHUNKS_MAX];    // QUEUED chunks in file order
+    int queue_head;
+    int queue_count;
+    int free_count;
+    int error;              // a write failed, every further frame is dropped
+    struct anner_capture_stats stats;
+    uint64_t appended;      // bytes appended to the file so far
+    int container;          // ANNER_CONTAINER_*
+    struct anner_container_header header;
+    struct anner_format_layout layout;  // of the frames handed in, Y4M only
+    unsigned char *row;     // deinterleaved chroma row of an NV12 frame going into Y4M
+    struct anner_container_entry *index;
+    size_t index_count;
+    size_t index_capacity;
+    struct timespec start;
+    int stop;
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+};
+
+/*
+ * Create path for frames of frame_size bytes, preallocating room for
+ * frames_hint frames (0 for none), with chunks (2..ANNER_CAPTURE_CHUNKS_MAX)
+ * chunk buffers between the producer and the writer. Fewer chunks than a
+ * frame spans plus two are raised to that; -1 if it is above the maximum
+ * or on failure.
+ */
+int anner_capture_open(struct anner_capture *capture, const char *path, size_t frame_size,
+                       int frames_hint, int chunks);
+
+/*
+ * Same as anner_capture_open() for a file in container (ANNER_CONTAINER_*)
+ * holding w x h frames of the DRM fourcc format, handed in with a plane 0
+ * pitch of stride (<= 0 for the format default).
+ * Y4M takes YUV420 and NV12 only. -1 on failure.
+ */
+int anner_capture_open_container(struct anner_capture *capture, const char *path, int container,
+                                 int w, int h, uint32_t format, int stride, int fps,
+                                 int frames_hint, int chunks);
+
+/*
+ * Writes what is queued and the index, trims the file to the frames
+ * captured and closes it. -1 if a write failed.
+ */
+int anner_capture_close(struct anner_capture *capture);
+
+/* Append one frame. 0 when it is queued, 1 when it was dropped */
+int anner_capture_frame(struct anner_capture *capture, const void *frame);
+
+void anner_capture_get_stats(struct anner_capture *capture, struct anner_capture_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libdrm/drm_fourcc.h>
+
+#include "anner_container.h"
+
+static_assert(sizeof(struct anner_container_header) <= ANNER_CONTAINER_HEADER,
+              "the container header outgrew its reserved space");
+
+int anner_container_y4m_supported(uint32_t fourcc) {
+    return fourcc == DRM_FORMAT_YUV420 || fourcc == DRM_FORMAT_NV12;
+}
+
+int anner_container_y4m_layout(int w, int h, struct anner_format_layout *layout) {
+    int cw = (w + 1) / 2;
+
+    if (anner_format_layout(DRM_FORMAT_YUV420, w, h, w, layout) < 0)
+        return -1;
+    // the format default halves the pitch, Y4M keeps the last column of odd widths
+    layout->pitches[1] = cw;
+    layout->pitches[2] = cw;
+    layout->offsets[2] = layout->offsets[1] + cw * layout->heights[1];
+    layout->size = (size_t)layout->offsets[2] + (size_t)cw * layout->heights[2];
+    return 0;
+}
+
+int anner_container_y4m_header(char *buf, size_t size, int w, int h, int fps) {
+    int len;
+
+    // C420jpeg is plain 8 bit 4:2:0, which is what the capture writes
+    len = snprintf(buf, size, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", w, h, fps > 0 ? fps : 30);
+    return len > 0 && (size_t)len < size ? len : -1;
+}
+
+int anner_container_y4m_parse(const unsigned char *data, size_t size, int *w, int *h, int *fps,
+                              size_t *header_len) {
+    const char *end;
+    char line[ANNER_Y4M_HEADER_MAX * 2];
+    char *token;
+    char *save;
+    size_t len;
+
+    if (size < 10 || memcmp(data, "YUV4MPEG2 ", 10) != 0)
+        return -1;
+    end = (const char *)memchr(data, '\n', size < sizeof(line) ? size : sizeof(line));
+    if (!end)
+        return -1;
+    len = end - (const char *)data;
+    memcpy(line, data, len);
+    line[len] = '\0';
+
+    *w = *h = 0;
+    *fps = 0;
+    for (token = strtok_r(line + 10, " ", &save); token; token = strtok_r(NULL, " ", &save)) {
+        int num, den;
+
+        switch (token[0]) {
+        case 'W':
+            *w = atoi(token + 1);
+            break;
+        case 'H':
+            *h = atoi(token + 1);
+            break;
+        case 'F':
+            if (sscanf(token + 1, "%d:%d", &num, &den) == 2 && den > 0)
+                *fps = num / den;
+            break;
+        case 'C':
+            // 4:2:0 in any chroma siting, nothing else
+            if (strncmp(token + 1, "420", 3) != 0 || strstr(token, "p1"))
+                return -1;
+            break;
+        default:
+            break;
+        }
+    }
+    if (*w <= 0 || *h <= 0)
+        return -1;
+    *header_len = len + 1;
+    return 0;
+}
+
+const struct anner_container_header *anner_container_header_get(const unsigned char *data,
+                                                                size_t size) {
+    const struct anner_container_header *header = (const struct anner_container_header *)data;
+
+    if (size < ANNER_CONTAINER_HEADER || memcmp(header->magic, ANNER_CONTAINER_MAGIC, 8) != 0)
+        return NULL;
+    if (header->version != ANNER_CONTAINER_VERSION || header->w <= 0 || header->h <= 0 ||
+        !header->frame_size) {
+        printf("anner_container: unsupported header version %u\n", header->version);
+        return NULL;
+    }
+    return header;
+}
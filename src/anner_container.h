@@ -0,0 +1,87 @@
+#ifndef __ANNER_CONTAINER_H__
+#define __ANNER_CONTAINER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "anner.h"
+#include "anner_format.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Self-describing capture files.
+ *
+ * Y4M (YUV4MPEG2) is the container for YUV output: a text header with
+ * size and frame rate, then every frame as "FRAME\n" and packed I420
+ * planes. Frames have a fixed size, so frame i sits at a computed offset.
+ *
+ * Everything else, RGBA and dmabuf layouts with their stride and
+ * modifier, goes into the indexed raw container: a 4096 byte header,
+ * frames back to back as they are laid out in memory, and at the end an
+ * index of per-frame offsets and capture timestamps. The header points
+ * at the index once the capture is closed; a capture that never got
+ * closed still reads back through the fixed frame size. Multi-byte
+ * fields are little endian.
+ */
+
+/*
+ * The containers are the ANNER_CONTAINER_* values of include/anner.h,
+ * ANNER_CONTAINER_RAW being bare frames without a header.
+ */
+
+#define ANNER_CONTAINER_MAGIC   "ANNERAW1"
+#define ANNER_CONTAINER_VERSION 1
+#define ANNER_CONTAINER_HEADER  4096    // bytes reserved for the header, frames start aligned
+
+struct anner_container_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t fourcc;
+    uint64_t modifier;
+    int32_t w;
+    int32_t h;
+    int32_t stride;         // plane 0 pitch, the other planes follow anner_format
+    uint32_t fps;
+    uint64_t frame_size;
+    uint64_t frames;        // 0 until the capture is closed
+    uint64_t index_offset;  // file offset of frames entries, 0 until closed
+};
+
+struct anner_container_entry {
+    uint64_t offset;        // file offset of the frame
+    uint64_t timestamp_ns;  // since the capture was opened
+};
+
+#define ANNER_Y4M_FRAME     "FRAME\n"
+#define ANNER_Y4M_FRAME_LEN 6
+#define ANNER_Y4M_HEADER_MAX 128
+
+/* Formats Y4M can hold: I420 as is, NV12 is converted to I420 while captured */
+int anner_container_y4m_supported(uint32_t fourcc);
+
+/*
+ * Layout of a w x h Y4M frame behind its marker: packed I420 planes with
+ * the chroma rounded up for odd sizes, as the capture writes them. -1 on
+ * failure.
+ */
+int anner_container_y4m_layout(int w, int h, struct anner_format_layout *layout);
+
+/* Y4M stream header for w x h at fps into buf, its length or -1 */
+int anner_container_y4m_header(char *buf, size_t size, int w, int h, int fps);
+
+/* Parse the Y4M stream header at data, header_len includes its newline. -1 unless 4:2:0 8 bit */
+int anner_container_y4m_parse(const unsigned char *data, size_t size, int *w, int *h, int *fps,
+                              size_t *header_len);
+
+/* Header at data if it is a valid indexed raw header, NULL otherwise */
+const struct anner_container_header *anner_container_header_get(const unsigned char *data,
+                                                                size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
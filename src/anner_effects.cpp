@@ -3,35 +3,115 @@
 #include <math.h>
 #include <string.h>
 
-#include <assert.h>
-#include <errno.h>
-#include <sys/mman.h>
-#include <stdbool.h>
-
-#include <fcntl.h>
-#include <unistd.h>
-#include <sys/time.h>
-
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
-void matrix_rotation(GLfloat *data, uint32_t angle)
+
+#include "anner_effects.h"
+
+// Triangle strip, position (x, y) then texcoord (u, v)
+static const GLfloat gQuadVertices[] = {
+    -1.0f, -1.0f,   0.0f, 0.0f,
+     1.0f, -1.0f,   1.0f, 0.0f,
+    -1.0f,  1.0f,   0.0f, 1.0f,
+     1.0f,  1.0f,   1.0f, 1.0f,
+};
+
+void anner_transform_init(struct anner_transform *t)
+{
+    memset(t, 0, sizeof(*t));
+    t->scale = 1.0f;
+}
+
+void anner_transform_matrix(const struct anner_transform *t, int in_w, int in_h,
+                            GLfloat matrix[9], GLfloat clip[4])
+{
+    float crop_x = t->crop_x, crop_y = t->crop_y;
+    float crop_w = t->crop_w > 0 ? t->crop_w : in_w;
+    float crop_h = t->crop_h > 0 ? t->crop_h : in_h;
+    float scale = t->scale > 0.0f ? t->scale : 1.0f;
+    float angle = fmodf(t->angle, 360.0f);
+    float c, s, dx, dy;
+    float a00, a01, a10, a11;
+
+    if (angle < 0.0f)
+        angle += 360.0f;
+    // keep the common orientations exact, cosf(90) is not 0
+    if (angle == 0.0f) {
+        c = 1.0f; s = 0.0f;
+    } else if (angle == 90.0f) {
+        c = 0.0f; s = 1.0f;
+    } else if (angle == 180.0f) {
+        c = -1.0f; s = 0.0f;
+    } else if (angle == 270.0f) {
+        c = 0.0f; s = -1.0f;
+    } else {
+        c = cosf(angle * (float)M_PI / 180.0f);
+        s = sinf(angle * (float)M_PI / 180.0f);
+    }
+
+    /*
+     * Output coordinates are stretched onto the rotated crop rectangle, so
+     * the output size cancels out: centred output texcoords are scaled by
+     * the crop size (swapped when closer to 90/270), flipped, zoomed,
+     * rotated and finally normalised by the input size around the crop centre.
+     */
+    if (fabsf(s) > fabsf(c)) {
+        dx = crop_h;
+        dy = crop_w;
+    } else {
+        dx = crop_w;
+        dy = crop_h;
+    }
+    dx = (t->flip_h ? -dx : dx) / scale;
+    dy = (t->flip_v ? -dy : dy) / scale;
+
+    a00 =  c * dx / in_w;
+    a01 = -s * dy / in_w;
+    a10 =  s * dx / in_h;
+    a11 =  c * dy / in_h;
+
+    matrix[0] = a00;
+    matrix[1] = a10;
+    matrix[2] = 0.0f;
+    matrix[3] = a01;
+    matrix[4] = a11;
+    matrix[5] = 0.0f;
+    matrix[6] = (crop_x + crop_w * 0.5f) / in_w - 0.5f * (a00 + a01);
+    matrix[7] = (crop_y + crop_h * 0.5f) / in_h - 0.5f * (a10 + a11);
+    matrix[8] = 1.0f;
+
+    clip[0] = crop_x / in_w;
+    clip[1] = crop_y / in_h;
+    clip[2] = (crop_x + crop_w) / in_w;
+    clip[3] = (crop_y + crop_h) / in_h;
+}
+
+GLuint anner_quad_create(void)
+{
+    GLuint vbo = 0;
+
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(gQuadVertices), gQuadVertices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return vbo;
+}
+
+void anner_quad_draw(GLuint vbo)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (const void *)0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat),
+                          (const void *)(2 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
+
+void anner_quad_destroy(GLuint vbo)
 {
-    GLfloat ret = 0;
-    switch (angle) {
-        
-        case 90:            
-            ret = data[0]; data[0] = data[15]; data[15]=ret;
-            ret = data[1]; data[1] = data[16]; data[16]=ret;
-            ret = data[0]; data[0] = data[10]; data[10]=ret;
-            ret = data[1]; data[1] = data[11]; data[11]=ret;
-            ret = data[0]; data[0] = data[5]; data[5]=ret;
-            ret = data[1]; data[1] = data[6]; data[6]=ret;
-         case 180:
-            ret = data[0]; data[0] = data[10]; data[10]=ret;
-            ret = data[1]; data[1] = data[11]; data[11]=ret;
-            ret = data[5]; data[5] = data[15]; data[15]=ret;
-            ret = data[6]; data[6] = data[16]; data[16]=ret;
-        }
-}
\ No newline at end of file
+    if (vbo)
+        glDeleteBuffers(1, &vbo);
+}
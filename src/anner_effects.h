@@ -1,2 +1,46 @@
-int effects_angle = 0;
-void matrix_rotation(GLfloat *data, uint32_t angle);
\ No newline at end of file
+#ifndef __ANNER_EFFECTS_H__
+#define __ANNER_EFFECTS_H__
+
+#include <GLES2/gl2.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Geometric effects applied while sampling the input.
+ *
+ * The quad is static and lives in a VBO; rotation, flip, crop and scale
+ * are folded into one 3x3 matrix that maps output texture coordinates
+ * to input texture coordinates, so nothing depends on previous calls.
+ */
+struct anner_transform {
+    float angle;        // degrees, any value; multiples of 90 are exact
+    int flip_h;         // mirror the output horizontally
+    int flip_v;         // mirror the output vertically
+    int crop_x;         // source rectangle in input pixels,
+    int crop_y;         // crop_w/crop_h of 0 use the whole input
+    int crop_w;
+    int crop_h;
+    float scale;        // zoom around the crop centre, 1.0 maps the crop onto the output
+};
+
+void anner_transform_init(struct anner_transform *t);
+
+/*
+ * Column-major mat3 for glUniformMatrix3fv() and the valid input rectangle
+ * (min u, min v, max u, max v) outside of which the output is black.
+ */
+void anner_transform_matrix(const struct anner_transform *t, int in_w, int in_h,
+                            GLfloat matrix[9], GLfloat clip[4]);
+
+/* Static full screen quad: location 0 position, location 1 texcoord */
+GLuint anner_quad_create(void);
+void anner_quad_draw(GLuint vbo);
+void anner_quad_destroy(GLuint vbo);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,16 @@
+#include <string.h>
+
+#include "anner_extension.h"
+
+int anner_has_extension(const char *extensions, const char *name) {
+    size_t len = strlen(name);
+    const char *p = extensions;
+
+    // a bare strstr() would also match names that extend this one
+    while (p && (p = strstr(p, name)) != NULL) {
+        if ((p == extensions || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0'))
+            return 1;
+        p += len;
+    }
+    return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef __ANNER_EXTENSION_H__
+#define __ANNER_EXTENSION_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Whether the space separated extension string (glGetString(GL_EXTENSIONS),
+ * eglQueryString(..., EGL_EXTENSIONS)) lists name as a whole word. A NULL
+ * string, as from a call without a current context, lists nothing.
+ */
+int anner_has_extension(const char *extensions, const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
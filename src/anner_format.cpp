@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libdrm/drm_fourcc.h>
+
+#include "anner_format.h"
+
+#define ALIGN(_v, _d) (((_v) + ((_d) - 1)) & ~((_d) - 1))
+
+static const struct anner_format formats[] = {
+    //  fourcc                   planes  bpp          hsub vsub align yuv afbc_only
+    { DRM_FORMAT_ABGR8888,       1, { 32,  0,  0 }, 1, 1, 64, 0, 0 },
+    { DRM_FORMAT_ARGB8888,       1, { 32,  0,  0 }, 1, 1, 64, 0, 0 },
+    { DRM_FORMAT_XBGR8888,       1, { 32,  0,  0 }, 1, 1, 64, 0, 0 },
+    { DRM_FORMAT_XRGB8888,       1, { 32,  0,  0 }, 1, 1, 64, 0, 0 },
+    { DRM_FORMAT_RGB888,         1, { 24,  0,  0 }, 1, 1, 64, 0, 0 },
+    { DRM_FORMAT_BGR888,         1, { 24,  0,  0 }, 1, 1, 64, 0, 0 },
+    { DRM_FORMAT_RGB565,         1, { 16,  0,  0 }, 1, 1, 64, 0, 0 },
+    { DRM_FORMAT_R8,             1, {  8,  0,  0 }, 1, 1, 64, 0, 0 },
+    { DRM_FORMAT_GR88,           1, { 16,  0,  0 }, 1, 1, 64, 0, 0 },
+    { DRM_FORMAT_YUYV,           1, { 16,  0,  0 }, 1, 1, 64, 1, 0 },
+    { DRM_FORMAT_UYVY,           1, { 16,  0,  0 }, 1, 1, 64, 1, 0 },
+    { DRM_FORMAT_NV12,           2, {  8, 16,  0 }, 2, 2, 64, 1, 0 },
+    { DRM_FORMAT_NV21,           2, {  8, 16,  0 }, 2, 2, 64, 1, 0 },
+    { DRM_FORMAT_NV16,           2, {  8, 16,  0 }, 2, 1, 64, 1, 0 },
+    { DRM_FORMAT_NV61,           2, {  8, 16,  0 }, 2, 1, 64, 1, 0 },
+    { DRM_FORMAT_P010,           2, { 16, 32,  0 }, 2, 2, 64, 1, 0 },
+    { DRM_FORMAT_YUV420,         3, {  8,  8,  8 }, 2, 2, 64, 1, 0 },
+    { DRM_FORMAT_YVU420,         3, {  8,  8,  8 }, 2, 2, 64, 1, 0 },
+    // AFBC packs 4:2:0 in one plane, the pitch is ignored by the driver
+    { DRM_FORMAT_YUV420_8BIT,    1, { 12,  0,  0 }, 1, 1, 64, 1, 1 },
+};
+
+static const EGLint plane_attrs[ANNER_FORMAT_MAX_PLANES][5] = {
+    { EGL_DMA_BUF_PLANE0_FD_EXT, EGL_DMA_BUF_PLANE0_OFFSET_EXT, EGL_DMA_BUF_PLANE0_PITCH_EXT,
+      EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT },
+    { EGL_DMA_BUF_PLANE1_FD_EXT, EGL_DMA_BUF_PLANE1_OFFSET_EXT, EGL_DMA_BUF_PLANE1_PITCH_EXT,
+      EGL_DMA_BUF_PLANE1_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE1_MODIFIER_HI_EXT },
+    { EGL_DMA_BUF_PLANE2_FD_EXT, EGL_DMA_BUF_PLANE2_OFFSET_EXT, EGL_DMA_BUF_PLANE2_PITCH_EXT,
+      EGL_DMA_BUF_PLANE2_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE2_MODIFIER_HI_EXT },
+};
+
+const struct anner_format *anner_format_get(uint32_t fourcc) {
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        if (formats[i].fourcc == fourcc)
+            return &formats[i];
+    }
+    return NULL;
+}
+
+int anner_format_stride(uint32_t fourcc, int w) {
+    const struct anner_format *format = anner_format_get(fourcc);
+
+    if (!format)
+        return -1;
+    return ALIGN((w * format->bpp[0] + 7) / 8, format->pitch_align);
+}
+
+int anner_format_layout(uint32_t fourcc, int w, int h, int stride,
+                        struct anner_format_layout *layout) {
+    const struct anner_format *format = anner_format_get(fourcc);
+    size_t offset = 0;
+
+    if (!format)
+        return -1;
+    if (stride <= 0)
+        stride = anner_format_stride(fourcc, w);
+
+    memset(layout, 0, sizeof(*layout));
+    layout->planes = format->planes;
+    for (int i = 0; i < format->planes; i++) {
+        int hsub = i ? format->hsub : 1;
+        int vsub = i ? format->vsub : 1;
+
+        layout->offsets[i] = (int)offset;
+        layout->pitches[i] = (int)((int64_t)stride * format->bpp[i] / (format->bpp[0] * hsub));
+        layout->heights[i] = (h + vsub - 1) / vsub;
+        offset += (size_t)layout->pitches[i] * layout->heights[i];
+    }
+    layout->size = offset;
+    return 0;
+}
+
+EGLint *anner_format_attr(int fourcc, uint64_t modifier, int fd, int w, int h, int stride) {
+    const struct anner_format *format = anner_format_get(fourcc);
+    // linear buffers are described without a modifier, as drivers without the modifiers extension expect
+    int has_modifier = modifier != DRM_FORMAT_MOD_LINEAR && modifier != DRM_FORMAT_MOD_INVALID;
+    struct anner_format_layout layout;
+    EGLint *attr;
+    int n = 0;
+
+    if (anner_format_layout(fourcc, w, h, stride, &layout) < 0) {
+        printf("anner_format: unsupported format 0x%x\n", fourcc);
+        return NULL;
+    }
+    if (format->afbc_only && !has_modifier) {
+        printf("anner_format: format 0x%x only exists with an AFBC modifier\n", fourcc);
+        return NULL;
+    }
+
+    attr = (EGLint *)malloc((7 + ANNER_FORMAT_MAX_PLANES * 10) * sizeof(EGLint));
+    if (!attr)
+        return NULL;
+    attr[n++] = EGL_WIDTH;
+    attr[n++] = w;
+    attr[n++] = EGL_HEIGHT;
+    attr[n++] = h;
+    attr[n++] = EGL_LINUX_DRM_FOURCC_EXT;
+    attr[n++] = fourcc;
+    for (int i = 0; i < layout.planes; i++) {
+        attr[n++] = plane_attrs[i][0];
+        attr[n++] = fd;
+        attr[n++] = plane_attrs[i][1];
+        attr[n++] = layout.offsets[i];
+        attr[n++] = plane_attrs[i][2];
+        attr[n++] = layout.pitches[i];
+        if (has_modifier) {
+            attr[n++] = plane_attrs[i][3];
+            attr[n++] = (EGLint)(modifier & 0xffffffff);
+            attr[n++] = plane_attrs[i][4];
+            attr[n++] = (EGLint)(modifier >> 32);
+        }
+    }
+    attr[n++] = EGL_NONE;
+    return attr;
+}
@@ -0,0 +1,72 @@
+#ifndef __ANNER_FORMAT_H__
+#define __ANNER_FORMAT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * DRM fourcc traits.
+ *
+ * One table describes how every supported format is laid out in memory:
+ * its planes, their bits per pixel and chroma subsampling, and the pitch
+ * alignment the GPU expects. Allocation sizes, default strides and the
+ * EGL_LINUX_DMA_BUF_EXT attribute lists are all derived from it, so a new
+ * format is one table entry.
+ *
+ * Plane pitches follow the pitch of plane 0: a plane with twice the bits
+ * per pixel at half the horizontal resolution (NV12 chroma) has the same
+ * pitch, a plane with the same bits at half resolution (I420 chroma) half
+ * of it. Planes are stored back to back in one buffer.
+ */
+
+#define ANNER_FORMAT_MAX_PLANES 3
+
+struct anner_format {
+    uint32_t fourcc;
+    int planes;
+    int bpp[ANNER_FORMAT_MAX_PLANES];   // bits per pixel of each plane at its own resolution
+    int hsub;           // horizontal subsampling of the planes after the first
+    int vsub;           // vertical subsampling of the planes after the first
+    int pitch_align;    // bytes, plane 0
+    int yuv;
+    int afbc_only;      // no linear layout, only imported with an AFBC modifier
+};
+
+struct anner_format_layout {
+    int planes;
+    int offsets[ANNER_FORMAT_MAX_PLANES];
+    int pitches[ANNER_FORMAT_MAX_PLANES];
+    int heights[ANNER_FORMAT_MAX_PLANES];
+    size_t size;
+};
+
+/* Traits of fourcc, NULL if the format is unknown */
+const struct anner_format *anner_format_get(uint32_t fourcc);
+
+/* Smallest aligned pitch of plane 0 for a w pixels wide image, -1 if unknown */
+int anner_format_stride(uint32_t fourcc, int w);
+
+/*
+ * Offsets, pitches and total size of a w x h image with a plane 0 pitch of
+ * stride (<= 0 picks anner_format_stride()). -1 if the format is unknown.
+ */
+int anner_format_layout(uint32_t fourcc, int w, int h, int stride,
+                        struct anner_format_layout *layout);
+
+/*
+ * malloc()ed EGL_LINUX_DMA_BUF_EXT attribute list for the buffer behind fd.
+ * Non linear modifiers are passed for every plane. NULL on failure.
+ */
+EGLint *anner_format_attr(int fourcc, uint64_t modifier, int fd, int w, int h, int stride);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
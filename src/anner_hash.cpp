@@ -0,0 +1,94 @@
+#include <string.h>
+
+#include "anner_hash.h"
+
+#define HASH_LANES      8
+#define HASH_STRIPE     64
+#define HASH_BLOCK      1024    // bytes between scrambles, 16 stripes
+
+#define PRIME32_1 0x9E3779B1U
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+
+/* Lane keys, XORed into the input so zero pages do not collapse the multiply */
+static const uint64_t secret[HASH_LANES] = {
+    0xbe4ba423396cfeb8ULL, 0x1cad21f72c81017cULL, 0xdb979083e96dd4deULL, 0x1f67b3b7a4a44072ULL,
+    0x78e5c0cc4ee679cbULL, 0x2172ffcc7dd05a82ULL, 0x8e2443f7744608b8ULL, 0x4c263a81e69035e0ULL,
+};
+
+static inline uint64_t read64(const unsigned char *p) {
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void accumulate(uint64_t *acc, const unsigned char *stripe) {
+    for (int i = 0; i < HASH_LANES; i++) {
+        uint64_t value = read64(stripe + 8 * i);
+        uint64_t key = value ^ secret[i];
+
+        acc[i ^ 1] += value;
+        acc[i] += (key & 0xffffffff) * (key >> 32);
+    }
+}
+
+static inline void scramble(uint64_t *acc) {
+    for (int i = 0; i < HASH_LANES; i++) {
+        acc[i] ^= acc[i] >> 47;
+        acc[i] ^= secret[(i + 3) % HASH_LANES];
+        acc[i] *= PRIME32_1;
+    }
+}
+
+/* XOR of the two halves of the 128-bit product, without __int128 on 32-bit targets */
+static inline uint64_t mul_fold64(uint64_t a, uint64_t b) {
+    uint64_t lo_lo = (a & 0xffffffff) * (b & 0xffffffff);
+    uint64_t hi_lo = (a >> 32) * (b & 0xffffffff);
+    uint64_t lo_hi = (a & 0xffffffff) * (b >> 32);
+    uint64_t hi_hi = (a >> 32) * (b >> 32);
+    uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xffffffff) + lo_hi;
+    uint64_t upper = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+    uint64_t lower = (cross << 32) | (lo_lo & 0xffffffff);
+
+    return lower ^ upper;
+}
+
+static inline uint64_t avalanche(uint64_t h) {
+    h ^= h >> 37;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t anner_hash64(const void *data, size_t len, uint64_t seed) {
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t acc[HASH_LANES];
+    unsigned char tail[HASH_STRIPE];
+    size_t stripes = len / HASH_STRIPE;
+    uint64_t h;
+
+    for (int i = 0; i < HASH_LANES; i++) {
+        acc[i] = seed + secret[i] * PRIME64_1;
+    }
+    for (size_t s = 0; s < stripes; s++) {
+        accumulate(acc, p + s * HASH_STRIPE);
+        if ((s + 1) % (HASH_BLOCK / HASH_STRIPE) == 0)
+            scramble(acc);
+    }
+    if (len % HASH_STRIPE) {
+        memset(tail, 0, sizeof(tail));
+        memcpy(tail, p + stripes * HASH_STRIPE, len % HASH_STRIPE);
+        accumulate(acc, tail);
+    }
+
+    h = len * PRIME64_1;
+    for (int i = 0; i < HASH_LANES; i += 2) {
+        uint64_t a = acc[i] ^ secret[(i + 5) % HASH_LANES];
+        uint64_t b = acc[i + 1] ^ secret[(i + 6) % HASH_LANES];
+
+        h += mul_fold64(a, b);
+    }
+    return avalanche(h ^ PRIME64_2);
+}
@@ -0,0 +1,26 @@
+#ifndef __ANNER_HASH_H__
+#define __ANNER_HASH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Fast non-cryptographic 64-bit content hash, used to recognise frames a
+ * source sends again unchanged.
+ *
+ * Built like XXH3: eight 64-bit lanes consume 64-byte stripes with a
+ * 32x32->64 multiply-accumulate against a fixed secret, scrambled every
+ * kilobyte, so the inner loop maps onto NEON/SSE2 lanes and runs at memory
+ * bandwidth. It is not bit compatible with xxHash.
+ */
+uint64_t anner_hash64(const void *data, size_t len, uint64_t seed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
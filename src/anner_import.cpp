@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <libdrm/drm_fourcc.h>
+
+#include "anner_import.h"
+#include "anner_format.h"
+#include "anner_memory.h"
+#include "anner_extension.h"
+
+static void import_free(struct anner_import_cache *cache, struct anner_import *entry) {
+    if (entry->texture)
+        glDeleteTextures(1, &entry->texture);
+    if (entry->image != EGL_NO_IMAGE_KHR)
+        cache->destroy_image(cache->dpy, entry->image);
+    anner_memory_sub(ANNER_MEMORY_IMPORT, entry->size);
+}
+
+/* Least recently used entry other than the one used last, -1 if there is none */
+static int import_lru(struct anner_import_cache *cache) {
+    int lru = -1;
+
+    for (int i = 0; i < cache->count; i++) {
+        if (cache->entries[i].last_use == cache->tick)
+            continue;
+        if (lru < 0 || cache->entries[i].last_use < cache->entries[lru].last_use)
+            lru = i;
+    }
+    return lru;
+}
+
+static size_t import_size(const struct anner_import_key *key) {
+    struct anner_format_layout layout;
+
+    if (anner_format_layout(key->format, key->w, key->h, key->stride, &layout) < 0)
+        return (size_t)key->stride * key->h;
+    return layout.size;
+}
+
+static void import_remove(struct anner_import_cache *cache, int index) {
+    import_free(cache, &cache->entries[index]);
+    cache->count--;
+    if (index != cache->count)
+        cache->entries[index] = cache->entries[cache->count];
+    memset(&cache->entries[cache->count], 0, sizeof(struct anner_import));
+}
+
+int anner_import_cache_init(struct anner_import_cache *cache, EGLDisplay dpy) {
+    memset(cache, 0, sizeof(*cache));
+    cache->dpy = dpy;
+    cache->create_image = (PFNEGLCREATEIMAGEKHRPROC) eglGetProcAddress("eglCreateImageKHR");
+    cache->destroy_image = (PFNEGLDESTROYIMAGEKHRPROC) eglGetProcAddress("eglDestroyImageKHR");
+    cache->image_target_texture_2d =
+        (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC) eglGetProcAddress("glEGLImageTargetTexture2DOES");
+    if (!cache->create_image || !cache->destroy_image || !cache->image_target_texture_2d) {
+        printf("anner_import: EGL_KHR_image_base / GL_OES_EGL_image not available\n");
+        return -1;
+    }
+    // the shaders are ESSL 3.00, which needs the essl3 flavour of the extension
+    cache->has_external = anner_has_extension((const char *)glGetString(GL_EXTENSIONS),
+                                        "GL_OES_EGL_image_external_essl3");
+    return 0;
+}
+
+void anner_import_cache_destroy(struct anner_import_cache *cache) {
+    for (int i = 0; i < cache->count; i++) {
+        import_free(cache, &cache->entries[i]);
+    }
+    cache->count = 0;
+}
+
+int anner_import_key_init(struct anner_import_key *key, int fd, int w, int h,
+                          int stride, uint32_t format, uint64_t modifier) {
+    struct stat st;
+
+    memset(key, 0, sizeof(*key));
+    if (fstat(fd, &st) < 0) {
+        printf("anner_import: fstat on fd %d failed\n", fd);
+        return -1;
+    }
+    key->ino = st.st_ino;
+    key->w = w;
+    key->h = h;
+    key->stride = stride;
+    key->format = format;
+    key->modifier = modifier;
+    return 0;
+}
+
+struct anner_import *anner_import_lookup(struct anner_import_cache *cache,
+                                         const struct anner_import_key *key) {
+    for (int i = 0; i < cache->count; i++) {
+        struct anner_import *entry = &cache->entries[i];
+        if (!memcmp(&entry->key, key, sizeof(*key))) {
+            entry->last_use = ++cache->tick;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+struct anner_import *anner_import_create(struct anner_import_cache *cache,
+                                         const struct anner_import_key *key,
+                                         const EGLint *attr, GLenum target) {
+    struct anner_import *entry;
+    size_t size = import_size(key);
+    EGLImageKHR img;
+    int lru;
+
+    while (anner_memory_over_budget(ANNER_MEMORY_IMPORT, size) && (lru = import_lru(cache)) >= 0)
+        import_remove(cache, lru);
+
+    img = cache->create_image(cache->dpy, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT,
+                              (EGLClientBuffer)NULL, attr);
+    if (img == EGL_NO_IMAGE_KHR) {
+        printf("anner_import: eglCreateImageKHR failed: 0x%04x\n", eglGetError());
+        return NULL;
+    }
+
+    if (cache->count == ANNER_IMPORT_CACHE_SIZE)
+        import_remove(cache, import_lru(cache));
+
+    entry = &cache->entries[cache->count++];
+    entry->key = *key;
+    entry->image = img;
+    entry->target = target;
+    entry->last_use = ++cache->tick;
+    entry->size = size;
+    anner_memory_add(ANNER_MEMORY_IMPORT, size);
+
+    glGenTextures(1, &entry->texture);
+    glBindTexture(entry->target, entry->texture);
+    cache->image_target_texture_2d(entry->target, img);
+    glTexParameteri(entry->target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(entry->target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    // filters read past the border, repeat would bring in the opposite edge
+    glTexParameteri(entry->target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(entry->target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    return entry;
+}
+
+void anner_import_release(struct anner_import_cache *cache, int fd) {
+    struct stat st;
+
+    if (fstat(fd, &st) < 0)
+        return;
+    for (int i = cache->count - 1; i >= 0; i--) {
+        if (cache->entries[i].key.ino == (uint64_t)st.st_ino)
+            import_remove(cache, i);
+    }
+}
+
+int anner_import_is_yuv(uint32_t format) {
+    const struct anner_format *traits = anner_format_get(format);
+
+    return traits && traits->yuv;
+}
+
+/* One plane of a multi-planar buffer imported as its own single plane image */
+static struct anner_import *import_plane(struct anner_import_cache *cache,
+                                         const struct anner_import_key *key, int fd,
+                                         uint32_t format, int w, int h, int offset, int pitch) {
+    struct anner_import_key plane_key = *key;
+    struct anner_import *entry;
+
+    plane_key.format = format;
+    plane_key.w = w;
+    plane_key.h = h;
+    entry = anner_import_lookup(cache, &plane_key);
+    if (!entry) {
+        EGLint attr[] = {
+            EGL_WIDTH, w,
+            EGL_HEIGHT, h,
+            EGL_LINUX_DRM_FOURCC_EXT, (EGLint)format,
+            EGL_DMA_BUF_PLANE0_FD_EXT, fd,
+            EGL_DMA_BUF_PLANE0_OFFSET_EXT, offset,
+            EGL_DMA_BUF_PLANE0_PITCH_EXT, pitch,
+            EGL_NONE
+        };
+        entry = anner_import_create(cache, &plane_key, attr, GL_TEXTURE_2D);
+    }
+    return entry;
+}
+
+static struct anner_import *import_whole(struct anner_import_cache *cache,
+                                         const struct anner_import_key *key, int fd,
+                                         GLenum target) {
+    struct anner_import *entry;
+    EGLint *attr;
+
+    entry = anner_import_lookup(cache, key);
+    if (entry)
+        return entry;
+    attr = anner_format_attr(key->format, key->modifier, fd, key->w, key->h, key->stride);
+    if (!attr)
+        return NULL;
+    entry = anner_import_create(cache, key, attr, target);
+    free(attr);
+    return entry;
+}
+
+int anner_import_input(struct anner_import_cache *cache, const struct anner_import_key *key,
+                       int fd, struct anner_input *input) {
+    struct anner_format_layout layout;
+    struct anner_import *entry;
+    struct anner_import *uv;
+
+    memset(input, 0, sizeof(*input));
+    if (!anner_import_is_yuv(key->format)) {
+        entry = import_whole(cache, key, fd, GL_TEXTURE_2D);
+        if (!entry)
+            return -1;
+        input->texture = entry->texture;
+        input->target = GL_TEXTURE_2D;
+        input->program_format = ANNER_PROGRAM_FORMAT_RGB;
+        input->program_sampler = ANNER_PROGRAM_SAMPLER_2D;
+        return 0;
+    }
+
+    if (cache->has_external) {
+        entry = import_whole(cache, key, fd, GL_TEXTURE_EXTERNAL_OES);
+        if (entry) {
+            input->texture = entry->texture;
+            input->target = GL_TEXTURE_EXTERNAL_OES;
+            input->program_format = ANNER_PROGRAM_FORMAT_RGB;
+            input->program_sampler = ANNER_PROGRAM_SAMPLER_EXTERNAL;
+            return 0;
+        }
+        printf("anner_import: external import of 0x%x failed, trying planes\n", key->format);
+    }
+
+    if (key->format != DRM_FORMAT_NV12) {
+        printf("anner_import: format 0x%x needs GL_OES_EGL_image_external_essl3\n", key->format);
+        return -1;
+    }
+    if (key->modifier != DRM_FORMAT_MOD_LINEAR) {
+        // compressed or tiled planes can not be addressed by offset and pitch
+        printf("anner_import: modifier 0x%llx needs GL_OES_EGL_image_external_essl3\n",
+               (unsigned long long)key->modifier);
+        return -1;
+    }
+
+    /*
+     * Creating the chroma import may move entries around, keep the luma
+     * texture name rather than the entry. Luma is the most recently used
+     * entry so it can not be the one evicted.
+     */
+    anner_format_layout(key->format, key->w, key->h, key->stride, &layout);
+    entry = import_plane(cache, key, fd, DRM_FORMAT_R8, key->w, layout.heights[0],
+                         layout.offsets[0], layout.pitches[0]);
+    if (!entry)
+        return -1;
+    input->texture = entry->texture;
+    uv = import_plane(cache, key, fd, DRM_FORMAT_GR88, (key->w + 1) / 2, layout.heights[1],
+                      layout.offsets[1], layout.pitches[1]);
+    if (!uv)
+        return -1;
+    input->texture_uv = uv->texture;
+    input->target = GL_TEXTURE_2D;
+    input->program_format = ANNER_PROGRAM_FORMAT_NV12;
+    input->program_sampler = ANNER_PROGRAM_SAMPLER_2D;
+    return 0;
+}
+
+void anner_input_bind(const struct anner_input *input, GLenum filter) {
+    if (input->texture_uv) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, input->texture_uv);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(input->target, input->texture);
+    glTexParameteri(input->target, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(input->target, GL_TEXTURE_MIN_FILTER, filter);
+}
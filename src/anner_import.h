@@ -0,0 +1,115 @@
+#ifndef __ANNER_IMPORT_H__
+#define __ANNER_IMPORT_H__
+
+#include <stdint.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include "anner_program.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * dmabuf import cache.
+ *
+ * Importing a dmabuf (eglCreateImageKHR + texture) is expensive, while
+ * producers usually cycle through a small set of buffers. Imports are kept
+ * per EGL context, keyed by the buffer identity, and reused until the
+ * buffer is released or the entry is evicted as least recently used.
+ */
+
+struct anner_import_key {
+    uint64_t ino;       // dmabuf inode, stable for the lifetime of the buffer
+    int w;
+    int h;
+    int stride;
+    uint32_t format;
+    uint64_t modifier;
+};
+
+struct anner_import {
+    struct anner_import_key key;
+    EGLImageKHR image;
+    GLuint texture;
+    GLenum target;
+    uint32_t last_use;
+    size_t size;        // bytes of the imported buffer, for anner_memory
+};
+
+#define ANNER_IMPORT_CACHE_SIZE 32
+
+struct anner_import_cache {
+    EGLDisplay dpy;
+    struct anner_import entries[ANNER_IMPORT_CACHE_SIZE];
+    int count;
+    uint32_t tick;
+    int has_external;
+    PFNEGLCREATEIMAGEKHRPROC create_image;
+    PFNEGLDESTROYIMAGEKHRPROC destroy_image;
+    PFNGLEGLIMAGETARGETTEXTURE2DOESPROC image_target_texture_2d;
+};
+
+int anner_import_cache_init(struct anner_import_cache *cache, EGLDisplay dpy);
+void anner_import_cache_destroy(struct anner_import_cache *cache);
+
+/* Fill key from the dmabuf fd and its layout, -1 if fd is not a valid file */
+int anner_import_key_init(struct anner_import_key *key, int fd, int w, int h,
+                          int stride, uint32_t format, uint64_t modifier);
+
+/* Returns the cached import for key, NULL on miss */
+struct anner_import *anner_import_lookup(struct anner_import_cache *cache,
+                                         const struct anner_import_key *key);
+
+/*
+ * Import the buffer described by attr (EGL_LINUX_DMA_BUF_EXT attribute list)
+ * and bind it to a new texture of the given target (GL_TEXTURE_2D or
+ * GL_TEXTURE_EXTERNAL_OES). The least recently used entry is evicted when
+ * the cache is full or over its ANNER_MEMORY_IMPORT budget; the entry used
+ * last is never evicted. NULL on failure.
+ */
+struct anner_import *anner_import_create(struct anner_import_cache *cache,
+                                         const struct anner_import_key *key,
+                                         const EGLint *attr, GLenum target);
+
+/*
+ * What a render needs to sample an imported input: the texture(s), the
+ * texture target and the program variant able to read them.
+ */
+struct anner_input {
+    GLuint texture;         // whole image, or the luma plane for two-plane YUV
+    GLuint texture_uv;      // interleaved chroma plane, 0 if unused
+    GLenum target;
+    uint32_t program_format;
+    uint32_t program_sampler;
+};
+
+/* Formats sampled as YUV */
+int anner_import_is_yuv(uint32_t format);
+
+/*
+ * Look up or import the input buffer described by key. RGB formats are
+ * bound to GL_TEXTURE_2D. YUV formats are bound to GL_TEXTURE_EXTERNAL_OES
+ * where GL_OES_EGL_image_external_essl3 is available, so the driver does
+ * the colour conversion while sampling; otherwise NV12 falls back to two
+ * imports, R8 luma and GR88 chroma, converted by the shader, which only
+ * works for linear buffers. Plane offsets and pitches come from the
+ * anner_format table. -1 on failure.
+ */
+int anner_import_input(struct anner_import_cache *cache, const struct anner_import_key *key,
+                       int fd, struct anner_input *input);
+
+/* Bind the input texture(s) to units 0 and 1 with filter (GL_NEAREST or GL_LINEAR) */
+void anner_input_bind(const struct anner_input *input, GLenum filter);
+
+/* Drop every import of the buffer behind fd, call before the buffer is freed */
+void anner_import_release(struct anner_import_cache *cache, int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "anner_loader.h"
+
+/* ANNER_BUFFER_WRITE of anner_pool.h, which the window backends do not build */
+#define ANNER_LOADER_CPU_WRITE 2
+
+static void *loader_worker(void *arg) {
+    struct anner_loader *loader = (struct anner_loader *)arg;
+    struct anner_loader_slot *slot;
+    int ret;
+
+    pthread_mutex_lock(&loader->lock);
+    while (!loader->stop) {
+        slot = NULL;
+        for (int i = 0; i < loader->count; i++) {
+            if (loader->slots[i].state == ANNER_LOADER_FREE) {
+                slot = &loader->slots[i];
+                break;
+            }
+        }
+        if (!slot) {
+            pthread_cond_wait(&loader->changed, &loader->lock);
+            continue;
+        }
+        slot->state = ANNER_LOADER_LOADING;
+        slot->sequence = loader->next_load++;
+        slot->frame = (int)(slot->sequence % (uint32_t)loader->source->frames);
+        pthread_mutex_unlock(&loader->lock);
+
+        // the copy is where the time goes, page faults on the source included
+        if (slot->buffer.begin_cpu)
+            slot->buffer.begin_cpu(slot->buffer.fd, ANNER_LOADER_CPU_WRITE);
+        ret = anner_source_copy(loader->source, slot->frame, slot->buffer.data, slot->buffer.stride);
+        if (slot->buffer.end_cpu)
+            slot->buffer.end_cpu(slot->buffer.fd, ANNER_LOADER_CPU_WRITE);
+
+        pthread_mutex_lock(&loader->lock);
+        slot->failed = ret < 0;
+        slot->state = ANNER_LOADER_READY;
+        pthread_cond_broadcast(&loader->changed);
+    }
+    pthread_mutex_unlock(&loader->lock);
+    return NULL;
+}
+
+int anner_loader_init(struct anner_loader *loader, struct anner_source *source, int threads,
+                      const struct anner_loader_buffer *buffers, int count) {
+    memset(loader, 0, sizeof(*loader));
+    if (count < 1 || count > ANNER_LOADER_MAX || threads < 1 || threads > ANNER_LOADER_THREADS ||
+        !source->frames) {
+        printf("anner_loader: %d buffers / %d threads out of range 1..%d / 1..%d\n",
+               count, threads, ANNER_LOADER_MAX, ANNER_LOADER_THREADS);
+        return -1;
+    }
+    loader->source = source;
+    loader->count = count;
+    for (int i = 0; i < count; i++) {
+        loader->slots[i].buffer = buffers[i];
+    }
+    pthread_mutex_init(&loader->lock, NULL);
+    pthread_cond_init(&loader->changed, NULL);
+
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&loader->threads[i], NULL, loader_worker, loader) != 0) {
+            printf("anner_loader: failed to start worker %d\n", i);
+            anner_loader_destroy(loader);
+            return -1;
+        }
+        loader->thread_count++;
+    }
+    printf("anner_loader: %d workers %d buffers\n", threads, count);
+    return 0;
+}
+
+void anner_loader_destroy(struct anner_loader *loader) {
+    if (!loader->count)
+        return;
+    pthread_mutex_lock(&loader->lock);
+    loader->stop = 1;
+    pthread_cond_broadcast(&loader->changed);
+    pthread_mutex_unlock(&loader->lock);
+    for (int i = 0; i < loader->thread_count; i++) {
+        pthread_join(loader->threads[i], NULL);
+    }
+    pthread_cond_destroy(&loader->changed);
+    pthread_mutex_destroy(&loader->lock);
+    memset(loader, 0, sizeof(*loader));
+}
+
+/* Slot holding the next frame of the sequence once it is loaded, -1 if none. Called with the lock held */
+static int next_ready(struct anner_loader *loader) {
+    for (int i = 0; i < loader->count; i++) {
+        if (loader->slots[i].state == ANNER_LOADER_READY &&
+            loader->slots[i].sequence == loader->next_out)
+            return i;
+    }
+    return -1;
+}
+
+int anner_loader_acquire(struct anner_loader *loader, int timeout_ms, int *frame) {
+    struct timespec deadline;
+    int id;
+
+    if (!loader->count)
+        return -1;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    if (timeout_ms > 0) {
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    pthread_mutex_lock(&loader->lock);
+    for (;;) {
+        id = next_ready(loader);
+        if (id >= 0 || timeout_ms == 0)
+            break;
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&loader->changed, &loader->lock);
+        } else if (pthread_cond_timedwait(&loader->changed, &loader->lock, &deadline) == ETIMEDOUT) {
+            id = next_ready(loader);
+            break;
+        }
+    }
+    if (id < 0) {
+        pthread_mutex_unlock(&loader->lock);
+        return -1;
+    }
+    loader->next_out++;
+    if (loader->slots[id].failed) {
+        // skip the frame, the slot goes back to the workers
+        loader->slots[id].state = ANNER_LOADER_FREE;
+        pthread_cond_broadcast(&loader->changed);
+        pthread_mutex_unlock(&loader->lock);
+        return -1;
+    }
+    loader->slots[id].state = ANNER_LOADER_HELD;
+    pthread_mutex_unlock(&loader->lock);
+
+    // the consumer keeps the pace, the workers run ahead of it
+    anner_source_wait(loader->source);
+    if (frame)
+        *frame = loader->slots[id].frame;
+    return id;
+}
+
+const struct anner_loader_buffer *anner_loader_buffer(struct anner_loader *loader, int slot) {
+    if (slot < 0 || slot >= loader->count)
+        return NULL;
+    return &loader->slots[slot].buffer;
+}
+
+void anner_loader_release(struct anner_loader *loader, int slot) {
+    if (slot < 0 || slot >= loader->count)
+        return;
+    pthread_mutex_lock(&loader->lock);
+    if (loader->slots[slot].state == ANNER_LOADER_HELD) {
+        loader->slots[slot].state = ANNER_LOADER_FREE;
+        pthread_cond_broadcast(&loader->changed);
+    }
+    pthread_mutex_unlock(&loader->lock);
+}
@@ -0,0 +1,96 @@
+#ifndef __ANNER_LOADER_H__
+#define __ANNER_LOADER_H__
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "anner_source.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Background frame loader.
+ *
+ * Worker threads copy the next frames of an anner_source into staging
+ * buffers while the render thread uploads or draws the current one, so a
+ * page fault or a slow disk in the loader no longer stalls rendering and
+ * the other way round. The staging buffers are supplied by the caller:
+ * plain memory for the upload path, mapped dmabufs from the pool for the
+ * import path, which the GPU then reads without another copy.
+ *
+ * A slot goes FREE -> LOADING (a worker copies a frame in) -> READY ->
+ * HELD (taken by the consumer) -> FREE. Workers load frames in sequence
+ * order into whatever slot is free; the consumer always gets the next
+ * frame of the sequence, looping at the end of the source, paced to the
+ * source's frame rate.
+ */
+
+#define ANNER_LOADER_MAX      8
+#define ANNER_LOADER_THREADS  4
+
+enum anner_loader_state {
+    ANNER_LOADER_FREE = 0,
+    ANNER_LOADER_LOADING,
+    ANNER_LOADER_READY,
+    ANNER_LOADER_HELD,
+};
+
+struct anner_loader_buffer {
+    void *data;
+    int stride;         // plane 0 pitch of data
+    int fd;             // dmabuf behind data, -1 for plain memory
+    // CPU access bracket of the dmabuf (anner_buffer_begin_cpu/_end_cpu), NULL for plain memory
+    int (*begin_cpu)(int fd, int flags);
+    int (*end_cpu)(int fd, int flags);
+};
+
+struct anner_loader_slot {
+    int state;
+    struct anner_loader_buffer buffer;
+    uint32_t sequence;  // position of the loaded frame in the sequence
+    int frame;          // index of the loaded frame in the source
+    int failed;
+};
+
+struct anner_loader {
+    struct anner_source *source;
+    int count;
+    struct anner_loader_slot slots[ANNER_LOADER_MAX];
+    int thread_count;
+    pthread_t threads[ANNER_LOADER_THREADS];
+    uint32_t next_load;     // sequence number the next worker loads
+    uint32_t next_out;      // sequence number the consumer gets next
+    int stop;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+};
+
+/*
+ * Start threads (<= ANNER_LOADER_THREADS) workers loading frames of
+ * source into count (<= ANNER_LOADER_MAX) buffers, which must hold a
+ * frame each and stay valid until anner_loader_destroy(). -1 on failure.
+ */
+int anner_loader_init(struct anner_loader *loader, struct anner_source *source, int threads,
+                      const struct anner_loader_buffer *buffers, int count);
+
+/* Stops the workers once their current frame is loaded; held slots become invalid */
+void anner_loader_destroy(struct anner_loader *loader);
+
+/*
+ * Next frame of the sequence, waited for up to timeout_ms (< 0 forever)
+ * to be loaded. The slot is held until anner_loader_release(); frame is
+ * set to the index of the frame in the source. -1 on timeout or error.
+ */
+int anner_loader_acquire(struct anner_loader *loader, int timeout_ms, int *frame);
+
+const struct anner_loader_buffer *anner_loader_buffer(struct anner_loader *loader, int slot);
+
+void anner_loader_release(struct anner_loader *loader, int slot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "anner_memory.h"
+
+struct memory_counter {
+    uint64_t bytes;
+    uint64_t peak;
+    uint64_t count;
+    uint64_t budget;
+};
+
+static struct memory_counter counters[ANNER_MEMORY_COUNT];
+
+static int valid(int category) {
+    return category >= 0 && category < ANNER_MEMORY_COUNT;
+}
+
+void anner_memory_add(int category, uint64_t bytes) {
+    struct memory_counter *counter;
+    uint64_t now;
+    uint64_t peak;
+
+    if (!valid(category))
+        return;
+    counter = &counters[category];
+    now = __atomic_add_fetch(&counter->bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&counter->count, 1, __ATOMIC_RELAXED);
+    peak = __atomic_load_n(&counter->peak, __ATOMIC_RELAXED);
+    while (now > peak &&
+           !__atomic_compare_exchange_n(&counter->peak, &peak, now, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+void anner_memory_sub(int category, uint64_t bytes) {
+    if (!valid(category))
+        return;
+    __atomic_sub_fetch(&counters[category].bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&counters[category].count, 1, __ATOMIC_RELAXED);
+}
+
+int anner_memory_get(int category, struct anner_memory_stats *stats) {
+    if (!valid(category))
+        return -1;
+    stats->bytes = __atomic_load_n(&counters[category].bytes, __ATOMIC_RELAXED);
+    stats->peak = __atomic_load_n(&counters[category].peak, __ATOMIC_RELAXED);
+    stats->count = __atomic_load_n(&counters[category].count, __ATOMIC_RELAXED);
+    stats->budget = __atomic_load_n(&counters[category].budget, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int anner_memory_set_budget(int category, uint64_t bytes) {
+    if (!valid(category))
+        return -1;
+    __atomic_store_n(&counters[category].budget, bytes, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int anner_memory_over_budget(int category, uint64_t bytes) {
+    uint64_t budget;
+
+    if (!valid(category))
+        return 0;
+    budget = __atomic_load_n(&counters[category].budget, __ATOMIC_RELAXED);
+    return budget && __atomic_load_n(&counters[category].bytes, __ATOMIC_RELAXED) + bytes > budget;
+}
@@ -0,0 +1,61 @@
+#ifndef __ANNER_MEMORY_H__
+#define __ANNER_MEMORY_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Process-wide memory accounting.
+ *
+ * Every allocation and import of the library is counted in its category
+ * with the current and high-water byte totals. Buffers and scaler levels
+ * are memory the library owns; imports and targets are views of dmabufs
+ * owned by someone else (often the pool), so their bytes overlap with
+ * ANNER_MEMORY_BUFFER and tell how much memory the caches keep pinned.
+ *
+ * A category can be given a budget. Going over it does not fail by
+ * itself, the owners of evictable caches check it and drop idle or least
+ * recently used entries: the pool its idle buffers, the import cache its
+ * LRU imports. The counters are atomic and can be read from any thread.
+ *
+ * Only the dummy (dmabuf) backend is accounted. The X11 and Wayland
+ * backends do not build this module, so their window stream texture,
+ * unpack PBO ring and dirty tile shadow copy are not counted anywhere.
+ */
+
+enum anner_memory_category {
+    ANNER_MEMORY_BUFFER = 0,    // dumb / udmabuf / GBM buffers of the pool
+    ANNER_MEMORY_IMPORT,        // input EGLImages and their textures
+    ANNER_MEMORY_TARGET,        // output EGLImages, textures and FBOs
+    ANNER_MEMORY_SCALER,        // intermediate textures of the box pre-reduction
+    ANNER_MEMORY_READBACK,      // pack PBOs or client memory of the async readback
+    ANNER_MEMORY_COUNT,
+};
+
+struct anner_memory_stats {
+    uint64_t bytes;
+    uint64_t peak;
+    uint64_t count;     // live allocations
+    uint64_t budget;    // 0 when unlimited
+};
+
+void anner_memory_add(int category, uint64_t bytes);
+void anner_memory_sub(int category, uint64_t bytes);
+
+/* -1 for an unknown category */
+int anner_memory_get(int category, struct anner_memory_stats *stats);
+
+/* 0 removes the budget */
+int anner_memory_set_budget(int category, uint64_t bytes);
+
+/* Whether adding bytes to the category would exceed its budget */
+int anner_memory_over_budget(int category, uint64_t bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
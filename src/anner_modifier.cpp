@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libdrm/drm_fourcc.h>
+
+#include "anner_modifier.h"
+#include "anner_extension.h"
+
+static int format_supported(EGLDisplay dpy, uint32_t format) {
+    PFNEGLQUERYDMABUFFORMATSEXTPROC query_formats =
+        (PFNEGLQUERYDMABUFFORMATSEXTPROC) eglGetProcAddress("eglQueryDmaBufFormatsEXT");
+    EGLint formats[128];
+    EGLint count = 0;
+
+    if (!query_formats || !query_formats(dpy, 128, formats, &count))
+        return 1;   // can not tell, let the import decide
+    for (int i = 0; i < count; i++) {
+        if ((uint32_t)formats[i] == format)
+            return 1;
+    }
+    return 0;
+}
+
+int anner_modifier_query(EGLDisplay dpy, uint32_t format, int render,
+                         uint64_t *modifiers, int max) {
+    PFNEGLQUERYDMABUFMODIFIERSEXTPROC query_modifiers;
+    EGLuint64KHR supported[ANNER_MODIFIER_MAX];
+    EGLBoolean external_only[ANNER_MODIFIER_MAX];
+    EGLint count = 0;
+    int linear = 0;
+    int n = 0;
+
+    if (max <= 0)
+        return 0;
+    if (!anner_has_extension(eglQueryString(dpy, EGL_EXTENSIONS), "EGL_EXT_image_dma_buf_import_modifiers")) {
+        modifiers[0] = DRM_FORMAT_MOD_LINEAR;
+        return 1;
+    }
+    if (!format_supported(dpy, format)) {
+        printf("anner_modifier: format 0x%x can not be imported\n", format);
+        return 0;
+    }
+
+    query_modifiers = (PFNEGLQUERYDMABUFMODIFIERSEXTPROC) eglGetProcAddress("eglQueryDmaBufModifiersEXT");
+    if (!query_modifiers ||
+        !query_modifiers(dpy, format, ANNER_MODIFIER_MAX, supported, external_only, &count))
+        count = 0;
+
+    for (int i = 0; i < count && n < max; i++) {
+        if (render && external_only[i])
+            continue;
+        if (supported[i] == DRM_FORMAT_MOD_LINEAR)
+            linear = 1;
+        modifiers[n++] = supported[i];
+    }
+    // linear is implied when the driver lists nothing or only tiled layouts
+    if (!linear && n < max)
+        modifiers[n++] = DRM_FORMAT_MOD_LINEAR;
+    return n;
+}
+
+int anner_modifier_intersect(const uint64_t *a, int a_count, const uint64_t *b, int b_count,
+                             uint64_t *out, int max) {
+    int n = 0;
+
+    for (int i = 0; i < a_count && n < max; i++) {
+        for (int j = 0; j < b_count; j++) {
+            if (a[i] == b[j]) {
+                out[n++] = a[i];
+                break;
+            }
+        }
+    }
+    return n;
+}
@@ -0,0 +1,40 @@
+#ifndef __ANNER_MODIFIER_H__
+#define __ANNER_MODIFIER_H__
+
+#include <stdint.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Format modifier negotiation.
+ *
+ * The driver reports through EGL_EXT_image_dma_buf_import_modifiers which
+ * layouts (linear, AFBC, ...) it can import for a fourcc. Intersecting that
+ * list with the one of the other side of a buffer (allocator, display,
+ * decoder) gives the layouts both understand; allocating from it lets a
+ * buffer be compressed end to end.
+ */
+
+#define ANNER_MODIFIER_MAX 32
+
+/*
+ * Modifiers the GPU can import format with, linear always included.
+ * render drops the external-only ones, which can not back an FBO.
+ * Returns the count, 0 if the format can not be imported at all.
+ */
+int anner_modifier_query(EGLDisplay dpy, uint32_t format, int render,
+                         uint64_t *modifiers, int max);
+
+/* Modifiers of a that are also in b, in the order of a */
+int anner_modifier_intersect(const uint64_t *a, int a_count, const uint64_t *b, int b_count,
+                             uint64_t *out, int max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
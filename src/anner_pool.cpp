@@ -0,0 +1,452 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include <linux/dma-buf.h>
+#include <linux/udmabuf.h>
+
+#include <libdrm/drm_fourcc.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+#ifdef ANNER_HAVE_GBM
+#include <gbm.h>
+#endif
+
+#include "anner_pool.h"
+#include "anner_format.h"
+#include "anner_memory.h"
+
+/* Bytes the image needs with every plane, 0 for an unknown format */
+static size_t buffer_size(uint32_t format, int w, int h, int stride) {
+    struct anner_format_layout layout;
+
+    if (anner_format_layout(format, w, h, stride, &layout) < 0) {
+        printf("anner_pool: unknown format 0x%x\n", format);
+        return 0;
+    }
+    return layout.size;
+}
+
+static void buffer_free(struct anner_pool *pool, struct anner_buffer *buffer) {
+    struct drm_mode_destroy_dumb destroy_arg;
+
+    if (buffer->used)
+        anner_memory_sub(ANNER_MEMORY_BUFFER, buffer->size);
+    if (buffer->map)
+        munmap(buffer->map, buffer->size);
+    if (buffer->fd >= 0)
+        close(buffer->fd);
+#ifdef ANNER_HAVE_GBM
+    if (buffer->bo)
+        gbm_bo_destroy((struct gbm_bo *)buffer->bo);
+#endif
+    if (!buffer->handle) {
+        memset(buffer, 0, sizeof(*buffer));
+        buffer->fd = -1;
+        return;
+    }
+    memset(&destroy_arg, 0, sizeof(destroy_arg));
+    destroy_arg.handle = buffer->handle;
+    if (drmIoctl(pool->dev_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy_arg))
+        printf("anner_pool: failed to destroy dumb %u: %s\n", buffer->handle, strerror(errno));
+    memset(buffer, 0, sizeof(*buffer));
+    buffer->fd = -1;
+}
+
+/*
+ * The udmabuf keeps the memfd pages pinned, the memfd itself is closed
+ * once mapped. Sealing against shrinking is required by the driver.
+ */
+static int udmabuf_create(struct anner_pool *pool, struct anner_buffer *buffer, size_t size) {
+    struct udmabuf_create create_arg;
+    long page = sysconf(_SC_PAGESIZE);
+    int memfd;
+
+    size = (size + page - 1) & ~(size_t)(page - 1);
+    memfd = memfd_create("anner_buffer", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0) {
+        printf("anner_pool: memfd_create failed: %s\n", strerror(errno));
+        return -1;
+    }
+    if (ftruncate(memfd, size) < 0 || fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK) < 0) {
+        printf("anner_pool: failed to size memfd: %s\n", strerror(errno));
+        close(memfd);
+        return -1;
+    }
+
+    memset(&create_arg, 0, sizeof(create_arg));
+    create_arg.memfd = memfd;
+    create_arg.flags = UDMABUF_FLAGS_CLOEXEC;
+    create_arg.offset = 0;
+    create_arg.size = size;
+    buffer->fd = ioctl(pool->dev_fd, UDMABUF_CREATE, &create_arg);
+    if (buffer->fd < 0) {
+        printf("anner_pool: UDMABUF_CREATE failed: %s\n", strerror(errno));
+        buffer->fd = -1;
+        close(memfd);
+        return -1;
+    }
+
+    buffer->map = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    close(memfd);
+    if (buffer->map == MAP_FAILED) {
+        printf("anner_pool: failed to mmap memfd: %s\n", strerror(errno));
+        buffer->map = NULL;
+        buffer_free(pool, buffer);
+        return -1;
+    }
+    buffer->size = size;
+    return 0;
+}
+
+static int dumb_create(struct anner_pool *pool, struct anner_buffer *buffer,
+                       uint32_t format, int stride, size_t size) {
+    const struct anner_format *traits = anner_format_get(format);
+    struct drm_mode_create_dumb alloc_arg;
+    struct drm_mode_map_dumb map_arg;
+    struct drm_prime_handle prime_arg;
+    int cpp = traits->bpp[0] / 8;
+
+    /*
+     * Rows of stride bytes at the first plane's depth, as many as the
+     * whole image takes: the chroma planes ride along as extra rows.
+     */
+    if (cpp < 1 || traits->bpp[0] % 8 || stride % cpp)
+        cpp = 1;
+    memset(&alloc_arg, 0, sizeof(alloc_arg));
+    alloc_arg.bpp = cpp * 8;
+    alloc_arg.width = stride / cpp;
+    alloc_arg.height = (size + stride - 1) / stride;
+    if (drmIoctl(pool->dev_fd, DRM_IOCTL_MODE_CREATE_DUMB, &alloc_arg)) {
+        printf("anner_pool: failed to create dumb buffer: %s\n", strerror(errno));
+        return -1;
+    }
+    buffer->handle = alloc_arg.handle;
+    buffer->size = alloc_arg.size;
+
+    memset(&prime_arg, 0, sizeof(prime_arg));
+    prime_arg.fd = -1;
+    prime_arg.handle = alloc_arg.handle;
+    prime_arg.flags = DRM_CLOEXEC | DRM_RDWR;
+    if (drmIoctl(pool->dev_fd, DRM_IOCTL_PRIME_HANDLE_TO_FD, &prime_arg)) {
+        printf("anner_pool: handle_to_fd failed handle=%x: %s\n", alloc_arg.handle, strerror(errno));
+        buffer_free(pool, buffer);
+        return -1;
+    }
+    buffer->fd = prime_arg.fd;
+
+    memset(&map_arg, 0, sizeof(map_arg));
+    map_arg.handle = alloc_arg.handle;
+    if (drmIoctl(pool->dev_fd, DRM_IOCTL_MODE_MAP_DUMB, &map_arg)) {
+        printf("anner_pool: failed to map dumb: %s\n", strerror(errno));
+        buffer_free(pool, buffer);
+        return -1;
+    }
+    buffer->map = mmap64(0, buffer->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                         pool->dev_fd, map_arg.offset);
+    if (buffer->map == MAP_FAILED) {
+        printf("anner_pool: failed to mmap buffer: %s\n", strerror(errno));
+        buffer->map = NULL;
+        buffer_free(pool, buffer);
+        return -1;
+    }
+    return 0;
+}
+
+static int buffer_create(struct anner_pool *pool, struct anner_buffer *buffer,
+                         int w, int h, int stride, uint32_t format) {
+    size_t size = buffer_size(format, w, h, stride);
+    int ret;
+
+    memset(buffer, 0, sizeof(*buffer));
+    buffer->fd = -1;
+    if (!size)
+        return -1;
+    if (pool->backend == ANNER_POOL_UDMABUF)
+        ret = udmabuf_create(pool, buffer, size);
+    else
+        ret = dumb_create(pool, buffer, format, stride, size);
+    if (ret < 0)
+        return -1;
+
+    buffer->used = 1;
+    buffer->w = w;
+    buffer->h = h;
+    buffer->stride = stride;
+    buffer->format = format;
+    buffer->modifier = DRM_FORMAT_MOD_LINEAR;
+    anner_memory_add(ANNER_MEMORY_BUFFER, buffer->size);
+    return 0;
+}
+
+#ifdef ANNER_HAVE_GBM
+static int gbm_create(struct anner_pool *pool, struct anner_buffer *buffer, int w, int h,
+                      uint32_t format, const uint64_t *modifiers, int count) {
+    struct gbm_bo *bo;
+
+    memset(buffer, 0, sizeof(*buffer));
+    buffer->fd = -1;
+    bo = gbm_bo_create_with_modifiers((struct gbm_device *)pool->gbm, w, h, format,
+                                      modifiers, count);
+    if (!bo) {
+        printf("anner_pool: gbm_bo_create_with_modifiers %dx%d 0x%x failed: %s\n",
+               w, h, format, strerror(errno));
+        return -1;
+    }
+    buffer->bo = bo;
+    buffer->fd = gbm_bo_get_fd(bo);
+    if (buffer->fd < 0) {
+        printf("anner_pool: gbm_bo_get_fd failed\n");
+        buffer_free(pool, buffer);
+        return -1;
+    }
+
+    buffer->used = 1;
+    buffer->w = w;
+    buffer->h = h;
+    buffer->stride = gbm_bo_get_stride(bo);
+    buffer->format = format;
+    buffer->modifier = gbm_bo_get_modifier(bo);
+    buffer->size = buffer_size(format, w, h, buffer->stride);
+    anner_memory_add(ANNER_MEMORY_BUFFER, buffer->size);
+    printf("anner_pool: gbm buffer %dx%d 0x%x modifier 0x%llx stride %d\n", w, h, format,
+           (unsigned long long)buffer->modifier, buffer->stride);
+    return 0;
+}
+#endif
+
+static int pool_open(struct anner_pool *pool, const char *device) {
+    pool->backend = strstr(device, "udmabuf") ? ANNER_POOL_UDMABUF : ANNER_POOL_DUMB;
+    pool->dev_fd = open(device, O_RDWR | O_CLOEXEC);
+    if (pool->dev_fd < 0) {
+        printf("anner_pool: failed to open %s: %s\n", device, strerror(errno));
+        return -1;
+    }
+    printf("anner_pool: allocating from %s\n", device);
+#ifdef ANNER_HAVE_GBM
+    if (pool->backend == ANNER_POOL_DUMB) {
+        pool->gbm = gbm_create_device(pool->dev_fd);
+        if (!pool->gbm)
+            printf("anner_pool: no gbm device on %s, buffers stay linear\n", device);
+    }
+#endif
+    return 0;
+}
+
+int anner_pool_init(struct anner_pool *pool, const char *device) {
+    memset(pool, 0, sizeof(*pool));
+    pool->dev_fd = -1;
+    for (int i = 0; i < ANNER_POOL_SIZE; i++) {
+        pool->buffers[i].fd = -1;
+    }
+    if (device)
+        return pool_open(pool, device);
+    // hosts without a display device still have system memory dmabufs
+    if (pool_open(pool, "/dev/dri/card0") < 0)
+        return pool_open(pool, "/dev/udmabuf");
+    return 0;
+}
+
+void anner_pool_destroy(struct anner_pool *pool) {
+    for (int i = 0; i < ANNER_POOL_SIZE; i++) {
+        if (pool->buffers[i].used)
+            buffer_free(pool, &pool->buffers[i]);
+    }
+#ifdef ANNER_HAVE_GBM
+    if (pool->gbm)
+        gbm_device_destroy((struct gbm_device *)pool->gbm);
+#endif
+    pool->gbm = NULL;
+    if (pool->dev_fd >= 0)
+        close(pool->dev_fd);
+    pool->dev_fd = -1;
+}
+
+/* full: an idle buffer of another bucket makes room */
+static struct anner_buffer *pool_evict(struct anner_pool *pool) {
+    for (int i = 0; i < ANNER_POOL_SIZE; i++) {
+        if (!pool->buffers[i].busy) {
+            buffer_free(pool, &pool->buffers[i]);
+            return &pool->buffers[i];
+        }
+    }
+    printf("anner_pool: all %d buffers are busy\n", ANNER_POOL_SIZE);
+    return NULL;
+}
+
+/* Free idle buffers until size more bytes fit the ANNER_MEMORY_BUFFER budget, -1 if they do not */
+static int pool_make_room(struct anner_pool *pool, size_t size) {
+    for (int i = 0; i < ANNER_POOL_SIZE && anner_memory_over_budget(ANNER_MEMORY_BUFFER, size); i++) {
+        if (pool->buffers[i].used && !pool->buffers[i].busy)
+            buffer_free(pool, &pool->buffers[i]);
+    }
+    if (anner_memory_over_budget(ANNER_MEMORY_BUFFER, size)) {
+        printf("anner_pool: %zu more bytes would exceed the buffer budget\n", size);
+        return -1;
+    }
+    return 0;
+}
+
+struct anner_buffer *anner_pool_acquire(struct anner_pool *pool, int w, int h,
+                                        int stride, uint32_t format) {
+    struct anner_buffer *slot = NULL;
+
+    if (pool->dev_fd < 0)
+        return NULL;
+    if (stride <= 0)
+        stride = anner_format_stride(format, w);
+    if (stride <= 0)
+        return NULL;
+
+    for (int i = 0; i < ANNER_POOL_SIZE; i++) {
+        struct anner_buffer *buffer = &pool->buffers[i];
+
+        if (!buffer->used) {
+            if (!slot)
+                slot = buffer;
+            continue;
+        }
+        // GBM buffers are never mapped, even linear ones, so only dumb/udmabuf ones are reused here
+        if (!buffer->busy && buffer->w == w && buffer->h == h && buffer->format == format &&
+            buffer->stride == stride && buffer->modifier == DRM_FORMAT_MOD_LINEAR &&
+            !buffer->bo) {
+            buffer->busy = 1;
+            return buffer;
+        }
+    }
+
+    if (!slot)
+        slot = pool_evict(pool);
+    if (!slot)
+        return NULL;
+
+    if (pool_make_room(pool, buffer_size(format, w, h, stride)) < 0)
+        return NULL;
+    if (buffer_create(pool, slot, w, h, stride, format) < 0)
+        return NULL;
+    slot->busy = 1;
+    return slot;
+}
+
+static int has_modifier(const uint64_t *modifiers, int count, uint64_t modifier) {
+    for (int i = 0; i < count; i++) {
+        if (modifiers[i] == modifier)
+            return 1;
+    }
+    return 0;
+}
+
+struct anner_buffer *anner_pool_acquire_modifiers(struct anner_pool *pool, int w, int h,
+                                                  uint32_t format, const uint64_t *modifiers,
+                                                  int count) {
+    struct anner_buffer *slot = NULL;
+    int linear = has_modifier(modifiers, count, DRM_FORMAT_MOD_LINEAR);
+
+    if (pool->dev_fd < 0 || count <= 0)
+        return NULL;
+    if (!pool->gbm || (linear && count == 1)) {
+        if (!linear) {
+            printf("anner_pool: only linear buffers can be allocated without gbm\n");
+            return NULL;
+        }
+        return anner_pool_acquire(pool, w, h, 0, format);
+    }
+
+#ifdef ANNER_HAVE_GBM
+    for (int i = 0; i < ANNER_POOL_SIZE; i++) {
+        struct anner_buffer *buffer = &pool->buffers[i];
+
+        if (!buffer->used) {
+            if (!slot)
+                slot = buffer;
+            continue;
+        }
+        if (!buffer->busy && buffer->bo && buffer->w == w && buffer->h == h &&
+            buffer->format == format && has_modifier(modifiers, count, buffer->modifier)) {
+            buffer->busy = 1;
+            return buffer;
+        }
+    }
+    if (!slot)
+        slot = pool_evict(pool);
+    if (!slot)
+        return NULL;
+    // the linear size is the estimate, AFBC only adds its block headers
+    if (pool_make_room(pool, buffer_size(format, w, h, 0)) < 0)
+        return NULL;
+    if (gbm_create(pool, slot, w, h, format, modifiers, count) < 0) {
+        if (!linear)
+            return NULL;
+        return anner_pool_acquire(pool, w, h, 0, format);
+    }
+    slot->busy = 1;
+    return slot;
+#else
+    (void)slot;
+    return NULL;
+#endif
+}
+
+struct anner_buffer *anner_pool_find(struct anner_pool *pool, int fd) {
+    for (int i = 0; i < ANNER_POOL_SIZE; i++) {
+        if (pool->buffers[i].busy && pool->buffers[i].fd == fd)
+            return &pool->buffers[i];
+    }
+    return NULL;
+}
+
+void anner_pool_release(struct anner_pool *pool, struct anner_buffer *buffer) {
+    int idle = 0;
+
+    if (!buffer || !buffer->busy)
+        return;
+    buffer->busy = 0;
+    for (int i = 0; i < ANNER_POOL_SIZE; i++) {
+        const struct anner_buffer *other = &pool->buffers[i];
+
+        if (other->used && !other->busy && other->w == buffer->w && other->h == buffer->h &&
+            other->format == buffer->format && other->stride == buffer->stride &&
+            other->modifier == buffer->modifier)
+            idle++;
+    }
+    if (idle > ANNER_POOL_IDLE_MAX)
+        buffer_free(pool, buffer);
+}
+
+static int buffer_sync(int fd, uint64_t flags) {
+    struct dma_buf_sync sync_arg;
+    int ret;
+
+    memset(&sync_arg, 0, sizeof(sync_arg));
+    sync_arg.flags = flags;
+    do {
+        ret = ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync_arg);
+    } while (ret < 0 && (errno == EINTR || errno == EAGAIN));
+    if (ret < 0)
+        printf("anner_pool: DMA_BUF_IOCTL_SYNC 0x%llx on fd %d failed: %s\n",
+               (unsigned long long)flags, fd, strerror(errno));
+    return ret;
+}
+
+static uint64_t sync_flags(int flags) {
+    uint64_t rw = 0;
+
+    if (flags & ANNER_BUFFER_READ)
+        rw |= DMA_BUF_SYNC_READ;
+    if (flags & ANNER_BUFFER_WRITE)
+        rw |= DMA_BUF_SYNC_WRITE;
+    return rw ? rw : DMA_BUF_SYNC_RW;
+}
+
+int anner_buffer_begin_cpu(int fd, int flags) {
+    return buffer_sync(fd, DMA_BUF_SYNC_START | sync_flags(flags));
+}
+
+int anner_buffer_end_cpu(int fd, int flags) {
+    return buffer_sync(fd, DMA_BUF_SYNC_END | sync_flags(flags));
+}
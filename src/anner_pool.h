@@ -0,0 +1,113 @@
+#ifndef __ANNER_POOL_H__
+#define __ANNER_POOL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * dmabuf buffer pool.
+ *
+ * One DRM device fd stays open for the lifetime of the pool. Dumb buffers
+ * are created with their own GEM handle, exported once as a dmabuf fd and
+ * mapped once. A released buffer goes back to its (w, h, format) bucket
+ * and is handed out again by the next matching acquire; only when a
+ * bucket holds more than ANNER_POOL_IDLE_MAX idle buffers is the buffer
+ * really freed.
+ *
+ * Buffers come from DRM dumb buffers or, on hosts without a display
+ * device (CI, llvmpipe), from sealed memfds turned into dmabufs by
+ * /dev/udmabuf. Both give the same fd/map/stride contract.
+ *
+ * With GBM (ANNER_HAVE_GBM) a buffer can also be allocated from a list of
+ * format modifiers, which lets the driver pick a compressed layout such as
+ * AFBC. Such buffers are not mapped and only ever reach the GPU or the
+ * display through their fd.
+ */
+
+#define ANNER_POOL_SIZE     64
+#define ANNER_POOL_IDLE_MAX 2
+
+enum anner_pool_backend {
+    ANNER_POOL_DUMB = 0,
+    ANNER_POOL_UDMABUF,
+};
+
+struct anner_buffer {
+    int used;           // slot holds a buffer
+    int busy;           // handed out by anner_pool_acquire()
+    uint32_t handle;    // GEM handle on the pool device, 0 for udmabuf
+    int fd;             // dmabuf fd, owned by the pool
+    void *map;
+    size_t size;
+    int w;
+    int h;
+    int stride;
+    uint32_t format;
+    uint64_t modifier;  // DRM_FORMAT_MOD_LINEAR unless allocated through GBM
+    void *bo;           // struct gbm_bo, NULL for dumb and udmabuf buffers
+};
+
+struct anner_pool {
+    int backend;
+    int dev_fd;         // DRM card or /dev/udmabuf
+    void *gbm;          // struct gbm_device on dev_fd, NULL without GBM
+    struct anner_buffer buffers[ANNER_POOL_SIZE];
+};
+
+/*
+ * Open device: a DRM card, or a path containing "udmabuf" for the memfd
+ * backend. NULL tries /dev/dri/card0 and falls back to /dev/udmabuf.
+ * -1 on failure.
+ */
+int anner_pool_init(struct anner_pool *pool, const char *device);
+
+/* Free every buffer, busy or not, and close the device */
+void anner_pool_destroy(struct anner_pool *pool);
+
+/*
+ * A mapped buffer sized by the anner_format layout of a w x h image of
+ * format, every plane included; stride <= 0 picks the format's aligned
+ * default. Reused from the bucket when an idle one exists. A new buffer
+ * that does not fit the ANNER_MEMORY_BUFFER budget first frees idle
+ * buffers of other buckets, and fails if that is not enough. NULL on failure.
+ */
+struct anner_buffer *anner_pool_acquire(struct anner_pool *pool, int w, int h,
+                                        int stride, uint32_t format);
+
+/*
+ * A buffer for a w x h image of format in one of modifiers, chosen by the
+ * driver. Without GBM, or when modifiers only allows it, this is a linear
+ * anner_pool_acquire() buffer. The layout picked is in buffer->modifier
+ * and buffer->stride; map is NULL for anything but linear. NULL on failure.
+ */
+struct anner_buffer *anner_pool_acquire_modifiers(struct anner_pool *pool, int w, int h,
+                                                  uint32_t format, const uint64_t *modifiers,
+                                                  int count);
+
+/* Busy buffer whose dmabuf fd is fd, NULL if it does not come from the pool */
+struct anner_buffer *anner_pool_find(struct anner_pool *pool, int fd);
+
+/* Give the buffer back to its bucket, the fd and mapping stay valid for the pool only */
+void anner_pool_release(struct anner_pool *pool, struct anner_buffer *buffer);
+
+/*
+ * CPU access to a mapped dmabuf has to be bracketed by these calls with
+ * what the CPU does in between (ANNER_BUFFER_READ and/or _WRITE), so the
+ * kernel can flush or invalidate caches and cached mappings stay
+ * coherent with the GPU. Works on any dmabuf fd. -1 on failure.
+ */
+#define ANNER_BUFFER_READ   1
+#define ANNER_BUFFER_WRITE  2
+
+int anner_buffer_begin_cpu(int fd, int flags);
+int anner_buffer_end_cpu(int fd, int flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,449 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include "anner_program.h"
+
+static const char gVertexShader[] =
+      "#version 300 es                            \n"
+      "layout(location = 0) in vec4 a_position;   \n"
+      "layout(location = 1) in vec2 a_texCoord;   \n"
+      "uniform mat3 u_transform;                  \n"
+      "out vec2 v_texCoord;                       \n"
+      "void main()                                \n"
+      "{                                          \n"
+      "   gl_Position = a_position;               \n"
+      "   v_texCoord = (u_transform * vec3(a_texCoord, 1.0)).xy;\n"
+      "}                                          \n";
+
+static const char gFragmentHeader[] =
+      "#version 300 es                                     \n";
+
+// Coordinates are highp so 4K inputs keep their sub-texel fraction
+static const char gFragmentPrecision[] =
+      "precision mediump float;                            \n"
+      "in highp vec2 v_texCoord;                           \n"
+      "layout(location = 0) out vec4 outColor;             \n"
+      "uniform vec4 u_clip;                                \n"
+      "bool outside(highp vec2 coord)                      \n"
+      "{                                                   \n"
+      "  return any(lessThan(coord, u_clip.xy)) ||         \n"
+      "         any(greaterThan(coord, u_clip.zw));        \n"
+      "}                                                   \n";
+
+static const char gExtensionExternal[] =
+      "#extension GL_OES_EGL_image_external_essl3 : require\n";
+
+static const char gSampler2D[] =
+      "uniform sampler2D s_texture;                        \n";
+
+static const char gSamplerExternal[] =
+      "uniform samplerExternalOES s_texture;               \n";
+
+static const char gSampleRGB[] =
+      "vec4 fetch_input(highp vec2 coord)                  \n"
+      "{                                                   \n"
+      "  return texture( s_texture, coord );               \n"
+      "}                                                   \n";
+
+// BT.601 limited range, what cameras and decoders produce by default
+static const char gSampleNV12[] =
+      "uniform sampler2D s_texture_uv;                     \n"
+      "vec4 fetch_input(highp vec2 coord)                  \n"
+      "{                                                   \n"
+      "  vec3 yuv = vec3(texture( s_texture, coord ).r,    \n"
+      "                  texture( s_texture_uv, coord ).rg);\n"
+      "  yuv -= vec3(0.0625, 0.5, 0.5);                    \n"
+      "  vec3 rgb = mat3(1.164,  1.164, 1.164,             \n"
+      "                  0.0,   -0.392, 2.017,             \n"
+      "                  1.596, -0.813, 0.0) * yuv;        \n"
+      "  return vec4(clamp(rgb, 0.0, 1.0), 1.0);           \n"
+      "}                                                   \n";
+
+static const char gFilterDirect[] =
+      "vec4 sample_input(highp vec2 coord)                 \n"
+      "{                                                   \n"
+      "  return fetch_input( coord );                      \n"
+      "}                                                   \n";
+
+/*
+ * Separable 4x4 kernels around the sample position. The texture is read
+ * with GL_NEAREST at texel centres.
+ */
+static const char gFilterTaps[] =
+      "uniform highp vec4 u_texel;                         \n"
+      "vec4 sample_taps(highp vec2 coord)                  \n"
+      "{                                                   \n"
+      "  highp vec2 pos = coord * u_texel.xy - 0.5;        \n"
+      "  highp vec2 base = floor( pos );                   \n"
+      "  vec2 f = pos - base;                              \n"
+      "  vec4 wx = weights( f.x );                         \n"
+      "  vec4 wy = weights( f.y );                         \n"
+      "  vec4 sum = vec4( 0.0 );                           \n"
+      "  for (int j = 0; j < 4; j++) {                     \n"
+      "    vec4 row = vec4( 0.0 );                         \n"
+      "    for (int i = 0; i < 4; i++) {                   \n"
+      "      highp vec2 tap = base + vec2( float(i) - 0.5, float(j) - 0.5 );\n"
+      "      row += wx[i] * fetch_input( tap * u_texel.zw );\n"
+      "    }                                               \n"
+      "    sum += wy[j] * row;                             \n"
+      "  }                                                 \n"
+      "  return clamp( sum, 0.0, 1.0 );                    \n"
+      "}                                                   \n"
+      "vec4 sample_input(highp vec2 coord)                 \n"
+      "{                                                   \n"
+      "  return sample_taps( coord );                      \n"
+      "}                                                   \n";
+
+// Catmull-Rom weights of the taps at -1, 0, 1, 2 for a fraction x
+static const char gWeightsBicubic[] =
+      "vec4 weights(float x)                               \n"
+      "{                                                   \n"
+      "  float x2 = x * x;                                 \n"
+      "  float x3 = x2 * x;                                \n"
+      "  return vec4( -0.5 * x3 + x2 - 0.5 * x,            \n"
+      "                1.5 * x3 - 2.5 * x2 + 1.0,          \n"
+      "               -1.5 * x3 + 2.0 * x2 + 0.5 * x,      \n"
+      "                0.5 * x3 - 0.5 * x2 );              \n"
+      "}                                                   \n";
+
+// Lanczos-2, normalised so flat areas stay flat
+static const char gWeightsLanczos[] =
+      "float lanczos(float x)                              \n"
+      "{                                                   \n"
+      "  if (abs( x ) < 1e-3)                              \n"
+      "    return 1.0;                                     \n"
+      "  float px = 3.14159265 * x;                        \n"
+      "  return 2.0 * sin( px ) * sin( px * 0.5 ) / (px * px);\n"
+      "}                                                   \n"
+      "vec4 weights(float x)                               \n"
+      "{                                                   \n"
+      "  vec4 w = vec4( lanczos( x + 1.0 ), lanczos( x ),  \n"
+      "                 lanczos( 1.0 - x ), lanczos( 2.0 - x ) );\n"
+      "  return w / dot( w, vec4( 1.0 ) );                 \n"
+      "}                                                   \n";
+
+static const char gEffectNone[] =
+      "void main()                                         \n"
+      "{                                                   \n"
+      "  if (outside( v_texCoord ))                        \n"
+      "    outColor = vec4( 0.0, 0.0, 0.0, 1.0 );          \n"
+      "  else                                              \n"
+      "    outColor = sample_input( v_texCoord );          \n"
+      "}                                                   \n";
+
+// Outside the clip the output is black, which the matrix offsets turn into YUV black
+static const char gEffectLuma[] =
+      "uniform vec4 u_csc[3];                              \n"
+      "void main()                                         \n"
+      "{                                                   \n"
+      "  vec4 rgb = vec4( 0.0, 0.0, 0.0, 1.0 );            \n"
+      "  if (!outside( v_texCoord ))                       \n"
+      "    rgb = vec4( sample_input( v_texCoord ).rgb, 1.0 );\n"
+      "  outColor = vec4( dot( u_csc[0], rgb ), 0.0, 0.0, 1.0 );\n"
+      "}                                                   \n";
+
+/*
+ * Drawn at half resolution, one fragment covers a 2x2 block of the output.
+ * The screen space derivatives give that footprint in input coordinates
+ * whatever the transform, so the four taps stay on the block's pixels.
+ */
+static const char gEffectChroma[] =
+      "uniform vec4 u_csc[3];                              \n"
+      "vec3 tap(highp vec2 coord)                          \n"
+      "{                                                   \n"
+      "  if (outside( coord ))                             \n"
+      "    return vec3( 0.0 );                             \n"
+      "  return sample_input( coord ).rgb;                 \n"
+      "}                                                   \n"
+      "void main()                                         \n"
+      "{                                                   \n"
+      "  highp vec2 dx = dFdx( v_texCoord ) * 0.25;        \n"
+      "  highp vec2 dy = dFdy( v_texCoord ) * 0.25;        \n"
+      "  vec4 rgb = vec4( 0.25 * (tap( v_texCoord - dx - dy ) +\n"
+      "                           tap( v_texCoord + dx - dy ) +\n"
+      "                           tap( v_texCoord - dx + dy ) +\n"
+      "                           tap( v_texCoord + dx + dy )), 1.0 );\n"
+      "  outColor = vec4( dot( u_csc[1], rgb ), dot( u_csc[2], rgb ), 0.0, 1.0 );\n"
+      "}                                                   \n";
+
+static const char* uniform_names[ANNER_UNIFORM_COUNT] = {
+    "s_texture",
+    "u_transform",
+    "u_clip",
+    "s_texture_uv",
+    "u_csc",
+    "u_texel",
+};
+
+static const GLfloat identity_transform[9] = {
+    1.0f, 0.0f, 0.0f,
+    0.0f, 1.0f, 0.0f,
+    0.0f, 0.0f, 1.0f,
+};
+
+static const GLfloat full_clip[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+
+// Y, U, V rows for RGB in [0, 1], offsets in the last column
+static const GLfloat csc_matrices[ANNER_COLORSPACE_COUNT][12] = {
+    {   // ANNER_COLORSPACE_BT601
+         0.2568f,  0.5041f,  0.0979f, 0.0625f,
+        -0.1482f, -0.2910f,  0.4392f, 0.5f,
+         0.4392f, -0.3678f, -0.0714f, 0.5f,
+    },
+    {   // ANNER_COLORSPACE_BT709
+         0.1826f,  0.6142f,  0.0620f, 0.0625f,
+        -0.1006f, -0.3386f,  0.4392f, 0.5f,
+         0.4392f, -0.3989f, -0.0403f, 0.5f,
+    },
+};
+
+static void checkGlError(const char* op) {
+    for (GLint error = glGetError(); error; error
+            = glGetError()) {
+        fprintf(stderr, "after %s() glError (0x%x)\n", op, error);
+    }
+}
+
+static GLuint loadShader(GLenum shaderType, const char** pSources, int count) {
+    GLuint shader = glCreateShader(shaderType);
+    if (shader) {
+        glShaderSource(shader, count, pSources, NULL);
+        glCompileShader(shader);
+        GLint compiled = 0;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+        if (!compiled) {
+            GLint infoLen = 0;
+            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLen);
+            fprintf(stderr, "Could not compile shader %x:\n", shaderType);
+            if (infoLen) {
+                char* buf = (char*) malloc(infoLen);
+                if (buf) {
+                    glGetShaderInfoLog(shader, infoLen, NULL, buf);
+                    fprintf(stderr, "%s\n", buf);
+                    free(buf);
+                }
+            }
+            glDeleteShader(shader);
+            shader = 0;
+        }
+    }
+    return shader;
+}
+
+static GLuint createProgram(const char** pVertexSources, int vertexCount,
+                            const char** pFragmentSources, int fragmentCount) {
+    GLuint vertexShader = loadShader(GL_VERTEX_SHADER, pVertexSources, vertexCount);
+    if (!vertexShader) {
+        return 0;
+    }
+
+    GLuint pixelShader = loadShader(GL_FRAGMENT_SHADER, pFragmentSources, fragmentCount);
+    if (!pixelShader) {
+        glDeleteShader(vertexShader);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    if (program) {
+        glAttachShader(program, vertexShader);
+        checkGlError("glAttachShader");
+        glAttachShader(program, pixelShader);
+        checkGlError("glAttachShader");
+        glLinkProgram(program);
+        GLint linkStatus = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+        if (linkStatus != GL_TRUE) {
+            GLint bufLength = 0;
+            glGetProgramiv(program, GL_INFO_LOG_LENGTH, &bufLength);
+            fprintf(stderr, "Could not link program:\n");
+            if (bufLength) {
+                char* buf = (char*) malloc(bufLength);
+                if (buf) {
+                    glGetProgramInfoLog(program, bufLength, NULL, buf);
+                    fprintf(stderr, "%s\n", buf);
+                    free(buf);
+                }
+            }
+            glDeleteProgram(program);
+            program = 0;
+        }
+    } else {
+        printf("create program faild\n");
+    }
+    // The program keeps the compiled code, the shader objects are no longer needed
+    glDeleteShader(vertexShader);
+    glDeleteShader(pixelShader);
+    return program;
+}
+
+/*
+ * Assemble the fragment shader for a variant from its parts:
+ * header, precision/io, sampler declaration, fetch function of the format,
+ * filter, effect.
+ */
+static int build_fragment(uint32_t key, const char** parts, int max) {
+    int n = 0;
+
+    if (max < 8)
+        return -1;
+    parts[n++] = gFragmentHeader;
+    if (ANNER_PROGRAM_KEY_SAMPLER(key) == ANNER_PROGRAM_SAMPLER_EXTERNAL)
+        parts[n++] = gExtensionExternal;
+    parts[n++] = gFragmentPrecision;
+
+    switch (ANNER_PROGRAM_KEY_SAMPLER(key)) {
+        case ANNER_PROGRAM_SAMPLER_2D:
+            parts[n++] = gSampler2D;
+            break;
+        case ANNER_PROGRAM_SAMPLER_EXTERNAL:
+            parts[n++] = gSamplerExternal;
+            break;
+        default:
+            return -1;
+    }
+
+    switch (ANNER_PROGRAM_KEY_FORMAT(key)) {
+        case ANNER_PROGRAM_FORMAT_RGB:
+            parts[n++] = gSampleRGB;
+            break;
+        case ANNER_PROGRAM_FORMAT_NV12:
+            // the planes are plain textures, the driver does not convert them
+            if (ANNER_PROGRAM_KEY_SAMPLER(key) != ANNER_PROGRAM_SAMPLER_2D)
+                return -1;
+            parts[n++] = gSampleNV12;
+            break;
+        default:
+            return -1;
+    }
+
+    switch (ANNER_PROGRAM_KEY_FILTER(key)) {
+        case ANNER_PROGRAM_FILTER_DIRECT:
+            parts[n++] = gFilterDirect;
+            break;
+        case ANNER_PROGRAM_FILTER_BICUBIC:
+            parts[n++] = gWeightsBicubic;
+            parts[n++] = gFilterTaps;
+            break;
+        case ANNER_PROGRAM_FILTER_LANCZOS:
+            parts[n++] = gWeightsLanczos;
+            parts[n++] = gFilterTaps;
+            break;
+        default:
+            return -1;
+    }
+
+    switch (ANNER_PROGRAM_KEY_EFFECT(key)) {
+        case ANNER_PROGRAM_EFFECT_NONE:
+            parts[n++] = gEffectNone;
+            break;
+        case ANNER_PROGRAM_EFFECT_LUMA:
+            parts[n++] = gEffectLuma;
+            break;
+        case ANNER_PROGRAM_EFFECT_CHROMA:
+            parts[n++] = gEffectChroma;
+            break;
+        default:
+            return -1;
+    }
+    return n;
+}
+
+void anner_program_cache_init(struct anner_program_cache *cache) {
+    memset(cache, 0, sizeof(*cache));
+}
+
+void anner_program_cache_destroy(struct anner_program_cache *cache) {
+    for (int i = 0; i < cache->count; i++) {
+        glDeleteProgram(cache->entries[i].program);
+    }
+    memset(cache, 0, sizeof(*cache));
+}
+
+const struct anner_program *anner_program_get(struct anner_program_cache *cache, uint32_t key) {
+    const char* vertex[] = { gVertexShader };
+    const char* fragment[8];
+    struct anner_program *entry;
+    int count;
+
+    for (int i = 0; i < cache->count; i++) {
+        if (cache->entries[i].key == key)
+            return &cache->entries[i];
+    }
+
+    if (cache->count >= ANNER_PROGRAM_CACHE_SIZE) {
+        fprintf(stderr, "anner_program: registry full, can not add variant 0x%x\n", key);
+        return NULL;
+    }
+
+    count = build_fragment(key, fragment, sizeof(fragment) / sizeof(fragment[0]));
+    if (count < 0) {
+        fprintf(stderr, "anner_program: unsupported variant 0x%x\n", key);
+        return NULL;
+    }
+
+    entry = &cache->entries[cache->count];
+    entry->program = createProgram(vertex, 1, fragment, count);
+    if (!entry->program)
+        return NULL;
+    entry->key = key;
+
+    for (int i = 0; i < ANNER_UNIFORM_COUNT; i++) {
+        entry->uniforms[i] = glGetUniformLocation(entry->program, uniform_names[i]);
+    }
+    checkGlError("glGetUniformLocation");
+
+    // Sampler units never change, bind them once at link time
+    glUseProgram(entry->program);
+    cache->current = entry->program;
+    if (entry->uniforms[ANNER_UNIFORM_TEXTURE] >= 0)
+        glUniform1i(entry->uniforms[ANNER_UNIFORM_TEXTURE], 0);
+    if (entry->uniforms[ANNER_UNIFORM_TEXTURE_UV] >= 0)
+        glUniform1i(entry->uniforms[ANNER_UNIFORM_TEXTURE_UV], 1);
+    // a program that is never given a transform samples the input 1:1
+    if (entry->uniforms[ANNER_UNIFORM_TRANSFORM] >= 0)
+        glUniformMatrix3fv(entry->uniforms[ANNER_UNIFORM_TRANSFORM], 1, GL_FALSE, identity_transform);
+    if (entry->uniforms[ANNER_UNIFORM_CLIP] >= 0)
+        glUniform4fv(entry->uniforms[ANNER_UNIFORM_CLIP], 1, full_clip);
+    anner_program_set_colorspace(entry, ANNER_COLORSPACE_BT601);
+
+    cache->count++;
+    printf("anner_program: compiled variant 0x%x program = %d\n", key, entry->program);
+    return entry;
+}
+
+const struct anner_program *anner_program_use(struct anner_program_cache *cache, uint32_t key) {
+    const struct anner_program *prog = anner_program_get(cache, key);
+
+    if (!prog)
+        return NULL;
+    if (cache->current != prog->program) {
+        glUseProgram(prog->program);
+        cache->current = prog->program;
+    }
+    return prog;
+}
+
+void anner_program_set_transform(const struct anner_program *prog,
+                                 const GLfloat matrix[9], const GLfloat clip[4]) {
+    if (prog->uniforms[ANNER_UNIFORM_TRANSFORM] >= 0)
+        glUniformMatrix3fv(prog->uniforms[ANNER_UNIFORM_TRANSFORM], 1, GL_FALSE, matrix);
+    if (prog->uniforms[ANNER_UNIFORM_CLIP] >= 0)
+        glUniform4fv(prog->uniforms[ANNER_UNIFORM_CLIP], 1, clip);
+}
+
+void anner_program_set_texel(const struct anner_program *prog, int w, int h) {
+    if (prog->uniforms[ANNER_UNIFORM_TEXEL] >= 0 && w > 0 && h > 0)
+        glUniform4f(prog->uniforms[ANNER_UNIFORM_TEXEL], (GLfloat)w, (GLfloat)h,
+                    1.0f / w, 1.0f / h);
+}
+
+void anner_program_set_colorspace(const struct anner_program *prog, int colorspace) {
+    if (colorspace < 0 || colorspace >= ANNER_COLORSPACE_COUNT)
+        colorspace = ANNER_COLORSPACE_BT601;
+    if (prog->uniforms[ANNER_UNIFORM_CSC] >= 0)
+        glUniform4fv(prog->uniforms[ANNER_UNIFORM_CSC], 3, csc_matrices[colorspace]);
+}
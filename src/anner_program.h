@@ -0,0 +1,109 @@
+#ifndef __ANNER_PROGRAM_H__
+#define __ANNER_PROGRAM_H__
+
+#include <stdint.h>
+#include <GLES2/gl2.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Shader program registry.
+ *
+ * Every backend (x11, wayland, dummy, egl_impl) keeps one registry per EGL
+ * context. A program is compiled and linked the first time its variant is
+ * requested, its uniform locations are looked up once, and afterwards the
+ * same GL program object is reused for every frame.
+ */
+
+/* Colour layout of the input the fragment shader has to sample */
+enum anner_program_format {
+    ANNER_PROGRAM_FORMAT_RGB = 0,
+    ANNER_PROGRAM_FORMAT_NV12,      // R8 luma + GR88 chroma, converted in the shader
+};
+
+/* Texture target the input is bound to */
+enum anner_program_sampler {
+    ANNER_PROGRAM_SAMPLER_2D = 0,
+    ANNER_PROGRAM_SAMPLER_EXTERNAL, // GL_TEXTURE_EXTERNAL_OES, the driver converts YUV
+};
+
+/* Per-pixel operation applied by the fragment shader */
+enum anner_program_effect {
+    ANNER_PROGRAM_EFFECT_NONE = 0,
+    ANNER_PROGRAM_EFFECT_LUMA,      // RGB -> Y into .r, for the R8 plane of an NV12 output
+    ANNER_PROGRAM_EFFECT_CHROMA,    // RGB -> 2x2 averaged UV into .rg, for the GR88 plane
+};
+
+/* How sample_input() reconstructs the input between texels */
+enum anner_program_filter {
+    ANNER_PROGRAM_FILTER_DIRECT = 0,    // one texture() lookup, nearest or bilinear by texture state
+    ANNER_PROGRAM_FILTER_BICUBIC,       // 4x4 Catmull-Rom taps
+    ANNER_PROGRAM_FILTER_LANCZOS,       // 4x4 Lanczos-2 taps
+};
+
+/* RGB -> YUV matrix of the LUMA/CHROMA effects, both limited range */
+enum anner_colorspace {
+    ANNER_COLORSPACE_BT601 = 0,
+    ANNER_COLORSPACE_BT709,
+    ANNER_COLORSPACE_COUNT,
+};
+
+#define ANNER_PROGRAM_KEY(format, sampler, effect, filter) \
+        (((uint32_t)(filter) << 24) | ((uint32_t)(format) << 16) | \
+         ((uint32_t)(sampler) << 8) | (uint32_t)(effect))
+#define ANNER_PROGRAM_KEY_FILTER(key)  (((key) >> 24) & 0xff)
+#define ANNER_PROGRAM_KEY_FORMAT(key)  (((key) >> 16) & 0xff)
+#define ANNER_PROGRAM_KEY_SAMPLER(key) (((key) >> 8) & 0xff)
+#define ANNER_PROGRAM_KEY_EFFECT(key)  ((key) & 0xff)
+
+/* Uniforms whose locations are cached at link time, -1 if unused */
+enum anner_uniform {
+    ANNER_UNIFORM_TEXTURE = 0,
+    ANNER_UNIFORM_TRANSFORM,    // mat3, output texcoord -> input texcoord
+    ANNER_UNIFORM_CLIP,         // vec4, valid input rectangle
+    ANNER_UNIFORM_TEXTURE_UV,   // chroma plane sampler, texture unit 1
+    ANNER_UNIFORM_CSC,          // vec4[3], RGB -> YUV rows with the offset in .w
+    ANNER_UNIFORM_TEXEL,        // vec4, sampled texture size in texels and its inverse
+    ANNER_UNIFORM_COUNT,
+};
+
+struct anner_program {
+    uint32_t key;
+    GLuint program;
+    GLint uniforms[ANNER_UNIFORM_COUNT];
+};
+
+#define ANNER_PROGRAM_CACHE_SIZE 16
+
+struct anner_program_cache {
+    struct anner_program entries[ANNER_PROGRAM_CACHE_SIZE];
+    int count;
+    GLuint current;
+};
+
+void anner_program_cache_init(struct anner_program_cache *cache);
+void anner_program_cache_destroy(struct anner_program_cache *cache);
+
+/* Returns the program for key, compiling it on first use. NULL on failure. */
+const struct anner_program *anner_program_get(struct anner_program_cache *cache, uint32_t key);
+
+/* Same as anner_program_get() and makes the program current if it is not already. */
+const struct anner_program *anner_program_use(struct anner_program_cache *cache, uint32_t key);
+
+/* Upload a transform/clip pair (see anner_transform_matrix()) to the current program */
+void anner_program_set_transform(const struct anner_program *prog,
+                                 const GLfloat matrix[9], const GLfloat clip[4]);
+
+/* Size of the texture the BICUBIC/LANCZOS filters read, a no-op for DIRECT */
+void anner_program_set_texel(const struct anner_program *prog, int w, int h);
+
+/* Upload the RGB -> YUV matrix for colorspace, a no-op for programs without one */
+void anner_program_set_colorspace(const struct anner_program *prog, int colorspace);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "anner_memory.h"
+#include "anner_readback.h"
+
+static int write_file(const char *path, const void *data, size_t size) {
+    FILE *file = fopen(path, "wb");
+    int ret = 0;
+
+    if (!file) {
+        printf("anner_readback: could not open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (fwrite(data, 1, size, file) != size)
+        ret = -1;
+    if (fclose(file) != 0)
+        ret = -1;
+    if (ret < 0)
+        printf("anner_readback: write of %s failed\n", path);
+    return ret;
+}
+
+static void *readback_writer(void *arg) {
+    struct anner_readback *rb = (struct anner_readback *)arg;
+    struct anner_readback_slot *slot;
+    int ret;
+
+    pthread_mutex_lock(&rb->lock);
+    for (;;) {
+        while (!rb->queue_count && !rb->stop)
+            pthread_cond_wait(&rb->changed, &rb->lock);
+        if (!rb->queue_count)
+            break;
+        slot = &rb->slots[rb->queue[rb->queue_head]];
+        pthread_mutex_unlock(&rb->lock);
+
+        // the mapping stays valid until the GL thread unmaps a WRITTEN slot
+        ret = write_file(slot->path, slot->map, slot->size);
+
+        pthread_mutex_lock(&rb->lock);
+        rb->queue_head = (rb->queue_head + 1) % ANNER_READBACK_SLOTS;
+        rb->queue_count--;
+        if (ret < 0)
+            rb->failed++;
+        else
+            rb->written++;
+        slot->state = ANNER_READBACK_WRITTEN;
+        pthread_cond_broadcast(&rb->changed);
+    }
+    pthread_mutex_unlock(&rb->lock);
+    return NULL;
+}
+
+int anner_readback_init(struct anner_readback *rb) {
+    const char *version = (const char *)glGetString(GL_VERSION);
+
+    memset(rb, 0, sizeof(*rb));
+    rb->gles3 = version && !strncmp(version, "OpenGL ES 3", 11);
+    for (int i = 0; rb->gles3 && i < ANNER_READBACK_SLOTS; i++) {
+        glGenBuffers(1, &rb->slots[i].pbo);
+    }
+    pthread_mutex_init(&rb->lock, NULL);
+    pthread_cond_init(&rb->changed, NULL);
+    if (pthread_create(&rb->writer, NULL, readback_writer, rb) != 0) {
+        printf("anner_readback: failed to start the writer\n");
+        for (int i = 0; i < ANNER_READBACK_SLOTS; i++) {
+            if (rb->slots[i].pbo)
+                glDeleteBuffers(1, &rb->slots[i].pbo);
+        }
+        pthread_cond_destroy(&rb->changed);
+        pthread_mutex_destroy(&rb->lock);
+        memset(rb, 0, sizeof(*rb));
+        return -1;
+    }
+    rb->running = 1;
+    printf("anner_readback: %s\n", rb->gles3 ? "pixel pack buffers" : "client memory");
+    return 0;
+}
+
+/* Give a slot whose copy has finished to the writer. Called with the lock held */
+static void slot_queue(struct anner_readback *rb, int id) {
+    rb->slots[id].state = ANNER_READBACK_WRITING;
+    rb->queue[(rb->queue_head + rb->queue_count) % ANNER_READBACK_SLOTS] = id;
+    rb->queue_count++;
+    pthread_cond_broadcast(&rb->changed);
+}
+
+/* Map the pbo of a PENDING slot once its copy is done, wait up to timeout_ns. 1 if it was queued */
+static int slot_complete(struct anner_readback *rb, int id, GLuint64 timeout_ns) {
+    struct anner_readback_slot *slot = &rb->slots[id];
+    GLenum ret;
+
+    ret = glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout_ns);
+    if (ret == GL_TIMEOUT_EXPIRED)
+        return 0;
+    glDeleteSync(slot->fence);
+    slot->fence = 0;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+    slot->map = ret == GL_WAIT_FAILED ? NULL :
+                glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot->size, GL_MAP_READ_BIT);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    pthread_mutex_lock(&rb->lock);
+    if (!slot->map) {
+        printf("anner_readback: readback of %s failed\n", slot->path);
+        rb->failed++;
+        slot->state = ANNER_READBACK_FREE;
+    } else {
+        slot_queue(rb, id);
+    }
+    pthread_mutex_unlock(&rb->lock);
+    return 1;
+}
+
+/* Unmap a WRITTEN slot. Called with the lock held */
+static void slot_recycle(struct anner_readback *rb, int id) {
+    struct anner_readback_slot *slot = &rb->slots[id];
+
+    if (rb->gles3) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    slot->map = NULL;
+    slot->state = ANNER_READBACK_FREE;
+}
+
+/* Oldest slot in state, -1 if none. Called with the lock held */
+static int oldest(struct anner_readback *rb, int state) {
+    int id = -1;
+
+    for (int i = 0; i < ANNER_READBACK_SLOTS; i++) {
+        if (rb->slots[i].state != state)
+            continue;
+        if (id < 0 || (int32_t)(rb->slots[i].sequence - rb->slots[id].sequence) < 0)
+            id = i;
+    }
+    return id;
+}
+
+/* Oldest PENDING slot, -1 if none */
+static int oldest_pending(struct anner_readback *rb) {
+    int id;
+
+    pthread_mutex_lock(&rb->lock);
+    id = oldest(rb, ANNER_READBACK_PENDING);
+    pthread_mutex_unlock(&rb->lock);
+    return id;
+}
+
+void anner_readback_poll(struct anner_readback *rb) {
+    int id;
+
+    // completions in order, so the writer sees files in readback order
+    while ((id = oldest_pending(rb)) >= 0 && slot_complete(rb, id, 0))
+        ;
+    pthread_mutex_lock(&rb->lock);
+    for (int i = 0; i < ANNER_READBACK_SLOTS; i++) {
+        if (rb->slots[i].state == ANNER_READBACK_WRITTEN)
+            slot_recycle(rb, i);
+    }
+    pthread_mutex_unlock(&rb->lock);
+}
+
+/* A FREE slot, waiting for the oldest readback to be written if there is none */
+static int slot_get(struct anner_readback *rb) {
+    int id;
+
+    anner_readback_poll(rb);
+    pthread_mutex_lock(&rb->lock);
+    for (;;) {
+        id = oldest(rb, ANNER_READBACK_FREE);
+        if (id >= 0)
+            break;
+        id = oldest(rb, ANNER_READBACK_WRITTEN);
+        if (id >= 0) {
+            slot_recycle(rb, id);
+            break;
+        }
+        id = oldest(rb, ANNER_READBACK_PENDING);
+        if (id >= 0) {
+            pthread_mutex_unlock(&rb->lock);
+            slot_complete(rb, id, GL_TIMEOUT_IGNORED);
+            pthread_mutex_lock(&rb->lock);
+            continue;
+        }
+        pthread_cond_wait(&rb->changed, &rb->lock);
+    }
+    pthread_mutex_unlock(&rb->lock);
+    return id;
+}
+
+/* Count what the slot holds as capacity bytes under ANNER_MEMORY_READBACK */
+static void slot_capacity(struct anner_readback_slot *slot, size_t capacity) {
+    if (slot->capacity)
+        anner_memory_sub(ANNER_MEMORY_READBACK, slot->capacity);
+    if (capacity)
+        anner_memory_add(ANNER_MEMORY_READBACK, capacity);
+    slot->capacity = capacity;
+}
+
+int anner_readback_read(struct anner_readback *rb, int x, int y, int w, int h, const char *path) {
+    struct anner_readback_slot *slot;
+    size_t size = (size_t)w * h * 4;
+    int id;
+
+    if (w <= 0 || h <= 0 || strlen(path) >= ANNER_READBACK_PATH)
+        return -1;
+    id = slot_get(rb);
+    slot = &rb->slots[id];
+    strcpy(slot->path, path);
+    slot->size = size;
+    slot->sequence = ++rb->sequence;
+
+    if (!rb->gles3) {
+        if (slot->capacity < size) {
+            free(slot->pixels);
+            slot->pixels = malloc(size);
+            slot_capacity(slot, slot->pixels ? size : 0);
+            if (!slot->pixels)
+                return -1;
+        }
+        glReadPixels(x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, slot->pixels);
+        slot->map = slot->pixels;
+        pthread_mutex_lock(&rb->lock);
+        slot_queue(rb, id);
+        pthread_mutex_unlock(&rb->lock);
+        return 0;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+    if (slot->capacity < size) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        slot_capacity(slot, size);
+    }
+    glReadPixels(x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // make sure the copy starts while the caller renders the next frame
+    glFlush();
+    pthread_mutex_lock(&rb->lock);
+    slot->state = ANNER_READBACK_PENDING;
+    pthread_mutex_unlock(&rb->lock);
+    return 0;
+}
+
+int anner_readback_flush(struct anner_readback *rb) {
+    int id;
+    int ret;
+
+    while ((id = oldest_pending(rb)) >= 0)
+        slot_complete(rb, id, GL_TIMEOUT_IGNORED);
+    pthread_mutex_lock(&rb->lock);
+    while (rb->queue_count)
+        pthread_cond_wait(&rb->changed, &rb->lock);
+    for (int i = 0; i < ANNER_READBACK_SLOTS; i++) {
+        if (rb->slots[i].state == ANNER_READBACK_WRITTEN)
+            slot_recycle(rb, i);
+    }
+    ret = rb->failed ? -1 : 0;
+    rb->failed = 0;
+    pthread_mutex_unlock(&rb->lock);
+    return ret;
+}
+
+void anner_readback_destroy(struct anner_readback *rb) {
+    if (!rb->running)
+        return;
+    anner_readback_flush(rb);
+    pthread_mutex_lock(&rb->lock);
+    rb->stop = 1;
+    pthread_cond_broadcast(&rb->changed);
+    pthread_mutex_unlock(&rb->lock);
+    pthread_join(rb->writer, NULL);
+
+    for (int i = 0; i < ANNER_READBACK_SLOTS; i++) {
+        if (rb->slots[i].pbo)
+            glDeleteBuffers(1, &rb->slots[i].pbo);
+        free(rb->slots[i].pixels);
+        slot_capacity(&rb->slots[i], 0);
+    }
+    pthread_cond_destroy(&rb->changed);
+    pthread_mutex_destroy(&rb->lock);
+    memset(rb, 0, sizeof(*rb));
+}
@@ -0,0 +1,88 @@
+#ifndef __ANNER_READBACK_H__
+#define __ANNER_READBACK_H__
+
+#include <stdint.h>
+#include <pthread.h>
+#include <GLES3/gl3.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Asynchronous framebuffer readback to files.
+ *
+ * glReadPixels() into a GL_PIXEL_PACK_BUFFER only queues the copy, so a
+ * readback is issued behind the draw calls of frame N together with a
+ * fence and the caller goes on rendering frame N+1. Once the fence has
+ * signaled the buffer is mapped and handed to a writer thread, which
+ * writes it to its file; the GL thread unmaps it when the writer is done.
+ * A slot goes FREE -> PENDING (copy queued) -> WRITING (mapped, owned by
+ * the writer) -> WRITTEN -> FREE, and files are written in readback order.
+ *
+ * Without ES 3.0 the readback is a blocking glReadPixels() into client
+ * memory, the file write still happens on the writer thread.
+ */
+
+#define ANNER_READBACK_SLOTS 3
+#define ANNER_READBACK_PATH  256
+
+enum anner_readback_state {
+    ANNER_READBACK_FREE = 0,
+    ANNER_READBACK_PENDING,
+    ANNER_READBACK_WRITING,
+    ANNER_READBACK_WRITTEN,
+};
+
+struct anner_readback_slot {
+    int state;
+    GLuint pbo;
+    GLsync fence;
+    size_t size;
+    size_t capacity;    // bytes allocated for pbo or pixels
+    void *map;          // mapped pbo, or pixels, while WRITING
+    void *pixels;       // client memory of the ES 2.0 fallback
+    uint32_t sequence;
+    char path[ANNER_READBACK_PATH];
+};
+
+struct anner_readback {
+    int gles3;
+    struct anner_readback_slot slots[ANNER_READBACK_SLOTS];
+    uint32_t sequence;
+    int queue[ANNER_READBACK_SLOTS];    // WRITING slots in readback order
+    int queue_head;
+    int queue_count;
+    uint64_t written;
+    uint64_t failed;
+    int running;        // writer started
+    int stop;
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+};
+
+/* Call with the GL context current, starts the writer thread. -1 on failure */
+int anner_readback_init(struct anner_readback *rb);
+
+/* Writes every queued readback, then stops the writer */
+void anner_readback_destroy(struct anner_readback *rb);
+
+/*
+ * Queue a readback of the w x h RGBA pixels at x, y of the current read
+ * framebuffer into path. Only waits when every slot is still in flight,
+ * for the oldest one. -1 on failure.
+ */
+int anner_readback_read(struct anner_readback *rb, int x, int y, int w, int h, const char *path);
+
+/* Hand finished readbacks to the writer and recycle written slots, never blocks */
+void anner_readback_poll(struct anner_readback *rb);
+
+/* Wait until every queued readback is written. -1 if any write since the last flush failed */
+int anner_readback_flush(struct anner_readback *rb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <libdrm/drm_fourcc.h>
+
+#include "anner_ring.h"
+#include "anner_format.h"
+
+static void slot_free(struct anner_ring *ring, struct anner_ring_slot *slot) {
+    anner_sync_fence_destroy(ring->sync, &slot->fence);
+    if (slot->target >= 0)
+        anner_target_remove(ring->targets, slot->target);
+    if (slot->buffer)
+        anner_pool_release(ring->pool, slot->buffer);
+    memset(slot, 0, sizeof(*slot));
+    slot->target = -1;
+    slot->fence.sync = EGL_NO_SYNC_KHR;
+    slot->fence.fd = -1;
+}
+
+int anner_ring_init(struct anner_ring *ring, struct anner_pool *pool,
+                    struct anner_target_set *targets, struct anner_sync *sync,
+                    int count, int w, int h, int stride, uint32_t format) {
+    memset(ring, 0, sizeof(*ring));
+    ring->pool = pool;
+    ring->targets = targets;
+    ring->sync = sync;
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->changed, NULL);
+    for (int i = 0; i < ANNER_RING_MAX; i++) {
+        ring->slots[i].target = -1;
+        ring->slots[i].fence.sync = EGL_NO_SYNC_KHR;
+        ring->slots[i].fence.fd = -1;
+    }
+    if (count < 1 || count > ANNER_RING_MAX) {
+        printf("anner_ring: count %d out of range 1..%d\n", count, ANNER_RING_MAX);
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        struct anner_ring_slot *slot = &ring->slots[i];
+        EGLint *attr;
+
+        slot->buffer = anner_pool_acquire(pool, w, h, stride, format);
+        if (!slot->buffer)
+            goto fail;
+        attr = anner_format_attr(format, DRM_FORMAT_MOD_LINEAR, slot->buffer->fd, w, h,
+                                 slot->buffer->stride);
+        slot->target = anner_target_add(targets, slot->buffer->fd, w, h, slot->buffer->stride,
+                                        format, attr);
+        free(attr);
+        if (slot->target < 0)
+            goto fail;
+        ring->count++;
+    }
+    printf("anner_ring: %d outputs %dx%d format 0x%x\n", count, w, h, format);
+    return 0;
+
+fail:
+    printf("anner_ring: failed to create output %d of %d\n", ring->count, count);
+    for (int i = 0; i < ANNER_RING_MAX; i++) {
+        slot_free(ring, &ring->slots[i]);
+    }
+    ring->count = 0;
+    return -1;
+}
+
+void anner_ring_destroy(struct anner_ring *ring) {
+    pthread_mutex_lock(&ring->lock);
+    for (int i = 0; i < ring->count; i++) {
+        while (ring->slots[i].state == ANNER_RING_HELD)
+            pthread_cond_wait(&ring->changed, &ring->lock);
+    }
+    pthread_mutex_unlock(&ring->lock);
+
+    for (int i = 0; i < ring->count; i++) {
+        slot_free(ring, &ring->slots[i]);
+    }
+    ring->count = 0;
+    pthread_cond_destroy(&ring->changed);
+    pthread_mutex_destroy(&ring->lock);
+}
+
+int anner_ring_begin(struct anner_ring *ring) {
+    int id = -1;
+
+    pthread_mutex_lock(&ring->lock);
+    for (int i = 0; i < ring->count; i++) {
+        if (ring->slots[i].state == ANNER_RING_FREE) {
+            ring->slots[i].state = ANNER_RING_RENDERING;
+            id = i;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ring->lock);
+    if (id < 0)
+        return -1;
+
+    if (anner_target_bind(ring->targets, ring->slots[id].target) < 0) {
+        pthread_mutex_lock(&ring->lock);
+        ring->slots[id].state = ANNER_RING_FREE;
+        pthread_mutex_unlock(&ring->lock);
+        return -1;
+    }
+    return id;
+}
+
+int anner_ring_submit(struct anner_ring *ring, int slot) {
+    struct anner_fence fence;
+    int ret;
+
+    if (slot < 0 || slot >= ring->count || ring->slots[slot].state != ANNER_RING_RENDERING)
+        return -1;
+    // a failed insert has already waited with glFinish(), the frame is still good
+    ret = anner_sync_fence_insert(ring->sync, &fence);
+
+    pthread_mutex_lock(&ring->lock);
+    ring->slots[slot].fence = fence;
+    ring->slots[slot].sequence = ++ring->sequence;
+    ring->slots[slot].state = ANNER_RING_QUEUED;
+    pthread_cond_broadcast(&ring->changed);
+    pthread_mutex_unlock(&ring->lock);
+    return ret;
+}
+
+/* Oldest queued slot, -1 if none. Called with the lock held */
+static int oldest_queued(struct anner_ring *ring) {
+    int id = -1;
+
+    for (int i = 0; i < ring->count; i++) {
+        if (ring->slots[i].state != ANNER_RING_QUEUED)
+            continue;
+        // sequence numbers wrap, compare their distance
+        if (id < 0 || (int32_t)(ring->slots[i].sequence - ring->slots[id].sequence) < 0)
+            id = i;
+    }
+    return id;
+}
+
+/* Milliseconds until the CLOCK_REALTIME deadline, rounded up, 0 once it has passed */
+static int ms_left(const struct timespec *deadline) {
+    struct timespec now;
+    int64_t ns;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    ns = (int64_t)(deadline->tv_sec - now.tv_sec) * 1000000000 + (deadline->tv_nsec - now.tv_nsec);
+    return ns > 0 ? (int)((ns + 999999) / 1000000) : 0;
+}
+
+int anner_ring_acquire(struct anner_ring *ring, int timeout_ms) {
+    struct timespec deadline;
+    int id;
+    int ret;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    if (timeout_ms > 0) {
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    pthread_mutex_lock(&ring->lock);
+    for (;;) {
+        id = oldest_queued(ring);
+        if (id >= 0 || timeout_ms == 0)
+            break;
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&ring->changed, &ring->lock);
+        } else if (pthread_cond_timedwait(&ring->changed, &ring->lock, &deadline) == ETIMEDOUT) {
+            id = oldest_queued(ring);
+            break;
+        }
+    }
+    if (id < 0) {
+        pthread_mutex_unlock(&ring->lock);
+        return -1;
+    }
+    ring->slots[id].state = ANNER_RING_HELD;
+    pthread_mutex_unlock(&ring->lock);
+
+    // the fence is only touched by the holder of the slot, and gets what is left of the timeout
+    ret = anner_sync_fence_wait(ring->sync, &ring->slots[id].fence,
+                                timeout_ms > 0 ? ms_left(&deadline) : timeout_ms);
+    if (ret != ANNER_FENCE_SIGNALED) {
+        pthread_mutex_lock(&ring->lock);
+        ring->slots[id].state = ANNER_RING_QUEUED;
+        pthread_mutex_unlock(&ring->lock);
+        return -1;
+    }
+    return id;
+}
+
+const struct anner_buffer *anner_ring_buffer(struct anner_ring *ring, int slot) {
+    if (slot < 0 || slot >= ring->count)
+        return NULL;
+    return ring->slots[slot].buffer;
+}
+
+void anner_ring_release(struct anner_ring *ring, int slot) {
+    if (slot < 0 || slot >= ring->count)
+        return;
+    pthread_mutex_lock(&ring->lock);
+    if (ring->slots[slot].state == ANNER_RING_HELD) {
+        anner_sync_fence_destroy(ring->sync, &ring->slots[slot].fence);
+        ring->slots[slot].state = ANNER_RING_FREE;
+        pthread_cond_broadcast(&ring->changed);
+    }
+    pthread_mutex_unlock(&ring->lock);
+}
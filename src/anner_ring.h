@@ -0,0 +1,88 @@
+#ifndef __ANNER_RING_H__
+#define __ANNER_RING_H__
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "anner_pool.h"
+#include "anner_sync.h"
+#include "anner_target.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Ring of offscreen outputs.
+ *
+ * Every slot is a pool buffer registered as a render target, so the
+ * producer can render frame N+1 into one slot while a consumer (encoder,
+ * network sender, file writer) still holds frame N in another. A slot
+ * goes FREE -> RENDERING -> QUEUED (fence inserted) -> HELD (taken by the
+ * consumer, fence waited) -> FREE. Frames are handed to the consumer in
+ * render order. Rendering stays on the GL thread; acquire and release may
+ * be called from any thread.
+ */
+
+#define ANNER_RING_MAX 8
+
+enum anner_ring_state {
+    ANNER_RING_FREE = 0,
+    ANNER_RING_RENDERING,
+    ANNER_RING_QUEUED,
+    ANNER_RING_HELD,
+};
+
+struct anner_ring_slot {
+    int state;
+    struct anner_buffer *buffer;
+    int target;             // anner_target id of the buffer
+    struct anner_fence fence;
+    uint32_t sequence;      // render order of the queued frame
+};
+
+struct anner_ring {
+    int count;
+    struct anner_pool *pool;
+    struct anner_target_set *targets;
+    struct anner_sync *sync;
+    struct anner_ring_slot slots[ANNER_RING_MAX];
+    uint32_t sequence;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+};
+
+/*
+ * Allocate count (<= ANNER_RING_MAX) outputs of w x h format and register
+ * them as targets. stride <= 0 picks the format default. -1 on failure.
+ */
+int anner_ring_init(struct anner_ring *ring, struct anner_pool *pool,
+                    struct anner_target_set *targets, struct anner_sync *sync,
+                    int count, int w, int h, int stride, uint32_t format);
+
+/* Waits for held frames to be released, then frees every slot */
+void anner_ring_destroy(struct anner_ring *ring);
+
+/* Free slot to render into, bound as the current target. -1 when every slot is queued or held */
+int anner_ring_begin(struct anner_ring *ring);
+
+/* Insert the fence of the rendered slot and queue it for the consumer */
+int anner_ring_submit(struct anner_ring *ring, int slot);
+
+/*
+ * Oldest queued frame, waited for up to timeout_ms (< 0 forever, 0 polls)
+ * to be queued and for its fence together. The slot is held until
+ * anner_ring_release().
+ * -1 on timeout or error.
+ */
+int anner_ring_acquire(struct anner_ring *ring, int timeout_ms);
+
+const struct anner_buffer *anner_ring_buffer(struct anner_ring *ring, int slot);
+
+void anner_ring_release(struct anner_ring *ring, int slot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
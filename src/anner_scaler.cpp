@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+
+#include "anner_effects.h"
+#include "anner_scaler.h"
+#include "anner_memory.h"
+
+static const GLfloat identity_transform[9] = {
+    1.0f, 0.0f, 0.0f,
+    0.0f, 1.0f, 0.0f,
+    0.0f, 0.0f, 1.0f,
+};
+
+static const GLfloat full_clip[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+
+static void level_free(struct anner_scaler_level *level) {
+    if (level->w)
+        anner_memory_sub(ANNER_MEMORY_SCALER, (uint64_t)level->w * level->h * 4);
+    if (level->fbo)
+        glDeleteFramebuffers(1, &level->fbo);
+    if (level->texture)
+        glDeleteTextures(1, &level->texture);
+    memset(level, 0, sizeof(*level));
+}
+
+static int level_alloc(struct anner_scaler_level *level, int w, int h) {
+    if (level->texture && level->w == w && level->h == h)
+        return 0;
+    level_free(level);
+
+    glGenTextures(1, &level->texture);
+    glBindTexture(GL_TEXTURE_2D, level->texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glGenFramebuffers(1, &level->fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, level->fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, level->texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        printf("anner_scaler: %dx%d level is incomplete\n", w, h);
+        level_free(level);
+        return -1;
+    }
+    level->w = w;
+    level->h = h;
+    anner_memory_add(ANNER_MEMORY_SCALER, (uint64_t)w * h * 4);
+    return 0;
+}
+
+void anner_scaler_init(struct anner_scaler *scaler) {
+    memset(scaler, 0, sizeof(*scaler));
+}
+
+void anner_scaler_destroy(struct anner_scaler *scaler) {
+    for (int i = 0; i < ANNER_SCALER_MAX_LEVELS; i++) {
+        level_free(&scaler->levels[i]);
+    }
+}
+
+int anner_scaler_levels(int mode, const GLfloat matrix[9], int in_w, int in_h,
+                        int out_w, int out_h) {
+    float ratio_x, ratio_y, ratio;
+    int levels = 0;
+
+    if (mode == ANNER_SCALER_NEAREST || out_w <= 0 || out_h <= 0)
+        return 0;
+    // input pixels covered by one output pixel along each output axis
+    ratio_x = hypotf(matrix[0] * in_w, matrix[1] * in_h) / out_w;
+    ratio_y = hypotf(matrix[3] * in_w, matrix[4] * in_h) / out_h;
+    ratio = ratio_x < ratio_y ? ratio_x : ratio_y;
+    while (levels < ANNER_SCALER_MAX_LEVELS && ratio >= 2.0f) {
+        ratio *= 0.5f;
+        levels++;
+    }
+    return levels;
+}
+
+int anner_scaler_prepare(struct anner_scaler *scaler, struct anner_program_cache *programs,
+                         GLuint quad, int mode, const struct anner_input *input,
+                         int in_w, int in_h, int levels, struct anner_scaler_source *source) {
+    GLint fbo = 0;
+
+    source->input = *input;
+    source->w = in_w;
+    source->h = in_h;
+    switch (mode) {
+        case ANNER_SCALER_BICUBIC:
+            source->filter = ANNER_PROGRAM_FILTER_BICUBIC;
+            break;
+        case ANNER_SCALER_LANCZOS:
+            source->filter = ANNER_PROGRAM_FILTER_LANCZOS;
+            break;
+        default:
+            source->filter = ANNER_PROGRAM_FILTER_DIRECT;
+            break;
+    }
+
+    if (levels > ANNER_SCALER_MAX_LEVELS)
+        levels = ANNER_SCALER_MAX_LEVELS;
+    if (levels > 0)
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fbo);
+
+    // one bilinear tap in the middle of each 2x2 block is the box average
+    for (int i = 0; i < levels; i++) {
+        struct anner_scaler_level *level = &scaler->levels[i];
+        const struct anner_program *prog;
+        int w = source->w > 1 ? source->w / 2 : 1;
+        int h = source->h > 1 ? source->h / 2 : 1;
+
+        if (level_alloc(level, w, h) < 0)
+            break;
+        glBindFramebuffer(GL_FRAMEBUFFER, level->fbo);
+        anner_input_bind(&source->input, GL_LINEAR);
+        prog = anner_program_use(programs, ANNER_PROGRAM_KEY(source->input.program_format,
+                                                             source->input.program_sampler,
+                                                             ANNER_PROGRAM_EFFECT_NONE,
+                                                             ANNER_PROGRAM_FILTER_DIRECT));
+        if (!prog)
+            break;
+        anner_program_set_transform(prog, identity_transform, full_clip);
+        glViewport(0, 0, w, h);
+        anner_quad_draw(quad);
+
+        memset(&source->input, 0, sizeof(source->input));
+        source->input.texture = level->texture;
+        source->input.target = GL_TEXTURE_2D;
+        source->input.program_format = ANNER_PROGRAM_FORMAT_RGB;
+        source->input.program_sampler = ANNER_PROGRAM_SAMPLER_2D;
+        source->w = w;
+        source->h = h;
+    }
+    if (levels > 0)
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+    // the kernels read texel centres themselves
+    anner_input_bind(&source->input, mode == ANNER_SCALER_NEAREST ||
+                                     source->filter != ANNER_PROGRAM_FILTER_DIRECT ?
+                                     GL_NEAREST : GL_LINEAR);
+    return 0;
+}
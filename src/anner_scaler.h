@@ -0,0 +1,76 @@
+#ifndef __ANNER_SCALER_H__
+#define __ANNER_SCALER_H__
+
+#include <stdint.h>
+#include <GLES2/gl2.h>
+
+#include "anner_program.h"
+#include "anner_import.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Input scaling.
+ *
+ * The final pass reconstructs the input with the selected kernel. For
+ * reductions of 2x or more the input is first halved with a 2x2 box
+ * filter, at most ANNER_SCALER_MAX_LEVELS times, into textures owned by
+ * the scaler, so the kernel never skips input pixels. Levels keep the
+ * normalised coordinates of the input, the transform stays valid for
+ * any level, and a frame never costs more than MAX_LEVELS extra passes.
+ */
+
+enum anner_scaler_mode {
+    ANNER_SCALER_NEAREST = 0,
+    ANNER_SCALER_BILINEAR,
+    ANNER_SCALER_BICUBIC,
+    ANNER_SCALER_LANCZOS,
+    ANNER_SCALER_COUNT,
+};
+
+#define ANNER_SCALER_MAX_LEVELS 3
+
+struct anner_scaler_level {
+    GLuint texture;     // RGBA8, half the size of the previous level
+    GLuint fbo;
+    int w;
+    int h;
+};
+
+struct anner_scaler {
+    struct anner_scaler_level levels[ANNER_SCALER_MAX_LEVELS];
+};
+
+/* What the final pass samples: the input itself or the last level */
+struct anner_scaler_source {
+    struct anner_input input;
+    int w;
+    int h;
+    uint32_t filter;    // enum anner_program_filter for the program key
+};
+
+void anner_scaler_init(struct anner_scaler *scaler);
+void anner_scaler_destroy(struct anner_scaler *scaler);
+
+/*
+ * Number of box levels needed to draw an in_w x in_h input through matrix
+ * (see anner_transform_matrix()) into an out_w x out_h viewport.
+ */
+int anner_scaler_levels(int mode, const GLfloat matrix[9], int in_w, int in_h,
+                        int out_w, int out_h);
+
+/*
+ * Build the levels, then bind the source with the texture filtering mode
+ * needs. The framebuffer binding is restored. -1 on failure.
+ */
+int anner_scaler_prepare(struct anner_scaler *scaler, struct anner_program_cache *programs,
+                         GLuint quad, int mode, const struct anner_input *input,
+                         int in_w, int in_h, int levels, struct anner_scaler_source *source);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
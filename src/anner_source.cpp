@@ -0,0 +1,292 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <libdrm/drm_fourcc.h>
+
+#include "anner_source.h"
+
+static size_t page_size(void) {
+    static size_t size;
+
+    if (!size)
+        size = (size_t)sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+static size_t frame_offset(struct anner_source *source, int index) {
+    if (source->index)
+        return source->index[index].offset;
+    return source->data_offset + (size_t)index * source->frame_step;
+}
+
+/* Ask the kernel to start reading the frames behind index */
+static void source_readahead(struct anner_source *source, int index) {
+    int first = index + 1 < source->frames ? index + 1 : 0;
+    int last = first + ANNER_SOURCE_READAHEAD - 1;
+    size_t start;
+    size_t end;
+
+    // the sequence loops, the start of the file is next after the last frame
+    if (last >= source->frames)
+        last = source->frames - 1;
+    start = frame_offset(source, first) & ~(page_size() - 1);
+    end = frame_offset(source, last) + source->layout.size;
+    if (end > start)
+        madvise((void *)(source->map + start), end - start, MADV_WILLNEED);
+}
+
+/* Describe the frames of an indexed capture, -1 if it is inconsistent */
+static int indexed_open(struct anner_source *source, const struct anner_container_header *header) {
+    size_t index_size = (size_t)header->frames * sizeof(struct anner_container_entry);
+    uint64_t frames;
+
+    source->container = ANNER_CONTAINER_INDEXED;
+    source->data_offset = ANNER_CONTAINER_HEADER;
+    source->frame_step = header->frame_size;
+    if (anner_format_layout(header->fourcc, header->w, header->h, header->stride, &source->layout) < 0 ||
+        source->layout.size != header->frame_size)
+        return -1;
+    if (header->index_offset) {
+        // the index follows the frames, every entry points at a whole frame in between
+        if (header->frames > INT_MAX || header->index_offset < ANNER_CONTAINER_HEADER + header->frame_size ||
+            header->index_offset > source->map_size || index_size > source->map_size - header->index_offset)
+            return -1;
+        source->index = (const struct anner_container_entry *)(source->map + header->index_offset);
+        source->frames = (int)header->frames;
+        for (int i = 0; i < source->frames; i++) {
+            if (source->index[i].offset < ANNER_CONTAINER_HEADER ||
+                source->index[i].offset > header->index_offset - header->frame_size)
+                return -1;
+        }
+    } else {
+        /*
+         * The capture was never closed, every frame up to the end of the
+         * file counts. That includes the zeroed preallocation behind the
+         * last frame written, which reads back as all-zero frames.
+         */
+        frames = (source->map_size - ANNER_CONTAINER_HEADER) / header->frame_size;
+        source->frames = frames > INT_MAX ? INT_MAX : (int)frames;
+    }
+    source->w = header->w;
+    source->h = header->h;
+    source->format = header->fourcc;
+    if (!source->fps)
+        source->fps = header->fps;
+    return 0;
+}
+
+/* Describe the frames of a Y4M stream, -1 unless it is plain 8 bit 4:2:0 */
+static int y4m_open(struct anner_source *source) {
+    size_t header_len;
+    int fps;
+
+    if (anner_container_y4m_parse(source->map, source->map_size, &source->w, &source->h, &fps,
+                                  &header_len) < 0)
+        return -1;
+    source->container = ANNER_CONTAINER_Y4M;
+    source->format = DRM_FORMAT_YUV420;
+    if (anner_container_y4m_layout(source->w, source->h, &source->layout) < 0)
+        return -1;
+    // frames with parameters would break the fixed step, only the bare marker is accepted
+    if (source->map_size < header_len + ANNER_Y4M_FRAME_LEN ||
+        memcmp(source->map + header_len, ANNER_Y4M_FRAME, ANNER_Y4M_FRAME_LEN) != 0)
+        return -1;
+    source->data_offset = header_len + ANNER_Y4M_FRAME_LEN;
+    source->frame_step = ANNER_Y4M_FRAME_LEN + source->layout.size;
+    source->frames = (int)((source->map_size - header_len) / source->frame_step);
+    if (!source->fps)
+        source->fps = fps;
+    return 0;
+}
+
+int anner_source_open(struct anner_source *source, const char *path, int w, int h,
+                      uint32_t format, int stride, int fps) {
+    const struct anner_container_header *header;
+    const struct anner_format *traits;
+    struct stat st;
+    void *map;
+    int ret;
+
+    memset(source, 0, sizeof(*source));
+    source->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (source->fd < 0) {
+        printf("anner_source: open %s failed: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (fstat(source->fd, &st) < 0 || !st.st_size) {
+        printf("anner_source: %s is empty\n", path);
+        anner_source_close(source);
+        return -1;
+    }
+    source->map_size = st.st_size;
+    map = mmap(NULL, source->map_size, PROT_READ, MAP_PRIVATE, source->fd, 0);
+    if (map == MAP_FAILED) {
+        printf("anner_source: mmap of %s failed: %s\n", path, strerror(errno));
+        source->map_size = 0;
+        anner_source_close(source);
+        return -1;
+    }
+    source->map = (const unsigned char *)map;
+    source->fps = fps > 0 ? fps : 0;
+
+    header = anner_container_header_get(source->map, source->map_size);
+    if (header) {
+        ret = indexed_open(source, header);
+    } else if (source->map_size >= 10 && !memcmp(source->map, "YUV4MPEG2 ", 10)) {
+        ret = y4m_open(source);
+    } else {
+        traits = anner_format_get(format);
+        // dumps are written without row padding
+        if (traits && stride <= 0)
+            stride = (w * traits->bpp[0] + 7) / 8;
+        ret = traits ? anner_format_layout(format, w, h, stride, &source->layout) : -1;
+        source->frame_step = source->layout.size;
+        source->frames = ret < 0 ? 0 : (int)(source->map_size / source->layout.size);
+        source->w = w;
+        source->h = h;
+        source->format = format;
+    }
+    if (ret < 0 || source->frames <= 0) {
+        printf("anner_source: %s holds no frame of a supported format\n", path);
+        anner_source_close(source);
+        return -1;
+    }
+
+    madvise(map, source->map_size, MADV_SEQUENTIAL);
+    source_readahead(source, -1);
+    clock_gettime(CLOCK_MONOTONIC, &source->due);
+    printf("anner_source: %s %d frames %dx%d format 0x%x container %d\n", path, source->frames,
+           source->w, source->h, source->format, source->container);
+    return 0;
+}
+
+void anner_source_close(struct anner_source *source) {
+    if (source->map)
+        munmap((void *)source->map, source->map_size);
+    if (source->fd >= 0)
+        close(source->fd);
+    memset(source, 0, sizeof(*source));
+    source->fd = -1;
+}
+
+const unsigned char *anner_source_frame(struct anner_source *source, int index) {
+    if (!source->map || index < 0 || index >= source->frames)
+        return NULL;
+    source_readahead(source, index);
+    return source->map + frame_offset(source, index);
+}
+
+int64_t anner_source_timestamp(struct anner_source *source, int index) {
+    if (!source->map || index < 0 || index >= source->frames)
+        return -1;
+    if (source->index)
+        return (int64_t)source->index[index].timestamp_ns;
+    return source->fps ? (int64_t)index * 1000000000LL / source->fps : -1;
+}
+
+void anner_source_wait(struct anner_source *source) {
+    struct timespec now;
+    int64_t late;
+    long period;
+
+    if (!source->fps)
+        return;
+    period = 1000000000L / source->fps;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &source->due, NULL) == EINTR)
+        ;
+    source->due.tv_nsec += period;
+    if (source->due.tv_nsec >= 1000000000L) {
+        source->due.tv_sec++;
+        source->due.tv_nsec -= 1000000000L;
+    }
+    // a consumer more than a frame late restarts the schedule instead of bursting
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    // 64 bit, a 32 bit long overflows once the consumer is about 2 s behind
+    late = (int64_t)(now.tv_sec - source->due.tv_sec) * 1000000000 + (now.tv_nsec - source->due.tv_nsec);
+    if (late > period)
+        source->due = now;
+}
+
+const unsigned char *anner_source_next(struct anner_source *source, int *index) {
+    int frame;
+
+    if (!source->map)
+        return NULL;
+    anner_source_wait(source);
+    frame = source->next;
+    source->next = frame + 1 < source->frames ? frame + 1 : 0;
+    if (index)
+        *index = frame;
+    return anner_source_frame(source, frame);
+}
+
+int anner_source_copy(struct anner_source *source, int index, void *dst, int dst_stride) {
+    const unsigned char *src = anner_source_frame(source, index);
+    struct anner_format_layout layout;
+
+    if (!src || !dst)
+        return -1;
+    if (anner_format_layout(source->format, source->w, source->h, dst_stride, &layout) < 0)
+        return -1;
+    if (layout.size == source->layout.size && dst_stride == source->layout.pitches[0]) {
+        memcpy(dst, src, layout.size);
+        return 0;
+    }
+    for (int i = 0; i < layout.planes; i++) {
+        const unsigned char *s = src + source->layout.offsets[i];
+        unsigned char *d = (unsigned char *)dst + layout.offsets[i];
+        int row = source->layout.pitches[i] < layout.pitches[i] ?
+                  source->layout.pitches[i] : layout.pitches[i];
+
+        for (int y = 0; y < layout.heights[i]; y++) {
+            memcpy(d, s, row);
+            s += source->layout.pitches[i];
+            d += layout.pitches[i];
+        }
+    }
+    return 0;
+}
+
+/* Frame source API of include/anner.h (C++ linkage, as declared there), the same for every backend */
+
+void* anner_open_frames(const char *path, int w, int h, int format, int stride, int fps) {
+    struct anner_source *source = (struct anner_source *)malloc(sizeof(*source));
+
+    if (!source)
+        return NULL;
+    if (anner_source_open(source, path, w, h, (uint32_t)format, stride, fps) < 0) {
+        free(source);
+        return NULL;
+    }
+    return source;
+}
+
+int anner_frame_count(void* frames) {
+    return frames ? ((struct anner_source *)frames)->frames : 0;
+}
+
+const unsigned char* anner_get_frame(void* frames, int index) {
+    return frames ? anner_source_frame((struct anner_source *)frames, index) : NULL;
+}
+
+const unsigned char* anner_next_frame(void* frames, int *index) {
+    return frames ? anner_source_next((struct anner_source *)frames, index) : NULL;
+}
+
+int64_t anner_frame_timestamp(void* frames, int index) {
+    return frames ? anner_source_timestamp((struct anner_source *)frames, index) : -1;
+}
+
+void anner_close_frames(void* frames) {
+    if (!frames)
+        return;
+    anner_source_close((struct anner_source *)frames);
+    free(frames);
+}
@@ -0,0 +1,84 @@
+#ifndef __ANNER_SOURCE_H__
+#define __ANNER_SOURCE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "anner_format.h"
+#include "anner_container.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Raw frame sequence source.
+ *
+ * A file of back to back frames of one size and format (a camera dump of
+ * BGRA, NV12, YUYV, ...) is mapped read-only instead of being read, and
+ * frames are handed out as views into the mapping. The kernel is told the
+ * access is sequential and the next frames are requested ahead of use, so
+ * replaying a long recording costs page cache hits rather than read()
+ * copies. anner_source_next() paces the sequence to a frame rate and loops
+ * at the end of the file.
+ *
+ * Y4M files and indexed anner_container captures describe their frames
+ * themselves; bare dumps have to be described by the caller. Either way
+ * a frame is found in O(1), through the index or the fixed frame size.
+ */
+
+#define ANNER_SOURCE_READAHEAD 4    // frames requested ahead of the one handed out
+
+struct anner_source {
+    int fd;
+    const unsigned char *map;
+    size_t map_size;
+    int w;
+    int h;
+    uint32_t format;
+    struct anner_format_layout layout;  // layout of one frame in the file
+    int container;          // ANNER_CONTAINER_*
+    size_t data_offset;     // file offset of frame 0
+    size_t frame_step;      // distance between frames without an index
+    const struct anner_container_entry *index;  // per-frame offsets, NULL if there is none
+    int frames;
+    int fps;                // 0 hands frames out as fast as they are asked for
+    int next;               // frame anner_source_next() hands out next
+    struct timespec due;    // when that frame is due
+};
+
+/*
+ * Map the frames of path. Bare dumps hold w x h pixels of the DRM fourcc
+ * format each, rows stride bytes apart (<= 0 for tightly packed rows);
+ * for Y4M and indexed captures w, h, format and stride come from the file
+ * and fps <= 0 takes the file's rate. A trailing partial frame is
+ * ignored. -1 on failure.
+ */
+int anner_source_open(struct anner_source *source, const char *path, int w, int h,
+                      uint32_t format, int stride, int fps);
+void anner_source_close(struct anner_source *source);
+
+/* View of frame index, valid until the source is closed. NULL if out of range */
+const unsigned char *anner_source_frame(struct anner_source *source, int index);
+
+/* Capture time of frame index in ns from the index, or its place at the frame rate. -1 if unknown */
+int64_t anner_source_timestamp(struct anner_source *source, int index);
+
+/* Sleep until the next frame is due at the source's frame rate, no-op without one */
+void anner_source_wait(struct anner_source *source);
+
+/* Wait until the next frame is due and return its view, index is set to its number */
+const unsigned char *anner_source_next(struct anner_source *source, int *index);
+
+/*
+ * Copy frame index into a CPU mapping of a buffer of the same size and
+ * format whose plane 0 rows are dst_stride bytes apart. -1 on failure.
+ */
+int anner_source_copy(struct anner_source *source, int index, void *dst, int dst_stride);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <GLES2/gl2.h>
+
+#include "anner_sync.h"
+#include "anner_extension.h"
+
+void anner_sync_init(struct anner_sync *sync, EGLDisplay dpy) {
+    const char *extensions = eglQueryString(dpy, EGL_EXTENSIONS);
+
+    memset(sync, 0, sizeof(*sync));
+    sync->dpy = dpy;
+    sync->create_sync = (PFNEGLCREATESYNCKHRPROC) eglGetProcAddress("eglCreateSyncKHR");
+    sync->destroy_sync = (PFNEGLDESTROYSYNCKHRPROC) eglGetProcAddress("eglDestroySyncKHR");
+    sync->client_wait_sync = (PFNEGLCLIENTWAITSYNCKHRPROC) eglGetProcAddress("eglClientWaitSyncKHR");
+    sync->dup_native_fence_fd =
+        (PFNEGLDUPNATIVEFENCEFDANDROIDPROC) eglGetProcAddress("eglDupNativeFenceFDANDROID");
+
+    sync->has_fence = anner_has_extension(extensions, "EGL_KHR_fence_sync") &&
+                      sync->create_sync && sync->destroy_sync && sync->client_wait_sync;
+    sync->has_native_fence = sync->has_fence &&
+                             anner_has_extension(extensions, "EGL_ANDROID_native_fence_sync") &&
+                             sync->dup_native_fence_fd;
+    printf("anner_sync: fence_sync %d native_fence_sync %d\n",
+           sync->has_fence, sync->has_native_fence);
+}
+
+int anner_sync_fence_insert(struct anner_sync *sync, struct anner_fence *fence) {
+    fence->sync = EGL_NO_SYNC_KHR;
+    fence->fd = -1;
+
+    if (!sync->has_fence) {
+        glFinish();
+        return 0;
+    }
+
+    if (sync->has_native_fence) {
+        EGLint attribs[] = {
+            EGL_SYNC_NATIVE_FENCE_FD_ANDROID, EGL_NO_NATIVE_FENCE_FD_ANDROID,
+            EGL_NONE
+        };
+        fence->sync = sync->create_sync(sync->dpy, EGL_SYNC_NATIVE_FENCE_ANDROID, attribs);
+    }
+    if (fence->sync == EGL_NO_SYNC_KHR)
+        fence->sync = sync->create_sync(sync->dpy, EGL_SYNC_FENCE_KHR, NULL);
+    if (fence->sync == EGL_NO_SYNC_KHR) {
+        printf("anner_sync: eglCreateSyncKHR failed: 0x%04x\n", eglGetError());
+        glFinish();
+        return -1;
+    }
+
+    // The native fence fd only exists once the commands have been flushed
+    glFlush();
+    if (sync->has_native_fence) {
+        fence->fd = sync->dup_native_fence_fd(sync->dpy, fence->sync);
+        if (fence->fd == EGL_NO_NATIVE_FENCE_FD_ANDROID)
+            fence->fd = -1;
+    }
+    return 0;
+}
+
+int anner_sync_fence_wait(struct anner_sync *sync, struct anner_fence *fence, int timeout_ms) {
+    EGLTimeKHR timeout;
+    EGLint ret;
+
+    if (fence->sync == EGL_NO_SYNC_KHR)
+        return ANNER_FENCE_SIGNALED;
+
+    timeout = timeout_ms < 0 ? EGL_FOREVER_KHR : (EGLTimeKHR)timeout_ms * 1000000ull;
+    ret = sync->client_wait_sync(sync->dpy, fence->sync, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, timeout);
+    if (ret == EGL_CONDITION_SATISFIED_KHR)
+        return ANNER_FENCE_SIGNALED;
+    if (ret == EGL_TIMEOUT_EXPIRED_KHR)
+        return ANNER_FENCE_TIMEOUT;
+    printf("anner_sync: eglClientWaitSyncKHR failed: 0x%04x\n", eglGetError());
+    return -1;
+}
+
+int anner_sync_fence_poll(struct anner_sync *sync, struct anner_fence *fence) {
+    if (fence->fd >= 0) {
+        struct pollfd pfd;
+        int ret;
+
+        pfd.fd = fence->fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        do {
+            ret = poll(&pfd, 1, 0);
+        } while (ret < 0 && errno == EINTR);
+        if (ret < 0)
+            return -1;
+        return ret ? ANNER_FENCE_SIGNALED : ANNER_FENCE_TIMEOUT;
+    }
+    return anner_sync_fence_wait(sync, fence, 0);
+}
+
+void anner_sync_fence_destroy(struct anner_sync *sync, struct anner_fence *fence) {
+    if (fence->sync != EGL_NO_SYNC_KHR)
+        sync->destroy_sync(sync->dpy, fence->sync);
+    if (fence->fd >= 0)
+        close(fence->fd);
+    fence->sync = EGL_NO_SYNC_KHR;
+    fence->fd = -1;
+}
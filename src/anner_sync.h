@@ -0,0 +1,60 @@
+#ifndef __ANNER_SYNC_H__
+#define __ANNER_SYNC_H__
+
+#include <stdint.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * GPU completion fences.
+ *
+ * A fence is inserted after the draw calls of a frame and flushed, so the
+ * caller returns immediately and waits (or polls) only when it actually
+ * needs the result. When EGL_ANDROID_native_fence_sync is available the
+ * fence is also exported as a sync_file fd that can be handed to the
+ * display or an encoder. Without any sync extension insertion falls back
+ * to glFinish() and the fence is born signaled.
+ */
+
+#define ANNER_FENCE_SIGNALED  0
+#define ANNER_FENCE_TIMEOUT   1
+
+#define ANNER_FENCE_FOREVER   (-1)
+
+struct anner_sync {
+    EGLDisplay dpy;
+    int has_fence;
+    int has_native_fence;
+    PFNEGLCREATESYNCKHRPROC create_sync;
+    PFNEGLDESTROYSYNCKHRPROC destroy_sync;
+    PFNEGLCLIENTWAITSYNCKHRPROC client_wait_sync;
+    PFNEGLDUPNATIVEFENCEFDANDROIDPROC dup_native_fence_fd;
+};
+
+struct anner_fence {
+    EGLSyncKHR sync;
+    int fd;     // sync_file fd, -1 when the driver can not export one
+};
+
+void anner_sync_init(struct anner_sync *sync, EGLDisplay dpy);
+
+/* Insert a fence behind the commands issued so far and flush them */
+int anner_sync_fence_insert(struct anner_sync *sync, struct anner_fence *fence);
+
+/* ANNER_FENCE_SIGNALED, ANNER_FENCE_TIMEOUT or -1 on error. timeout_ms < 0 waits forever */
+int anner_sync_fence_wait(struct anner_sync *sync, struct anner_fence *fence, int timeout_ms);
+
+/* Non blocking check, same return values as anner_sync_fence_wait() */
+int anner_sync_fence_poll(struct anner_sync *sync, struct anner_fence *fence);
+
+void anner_sync_fence_destroy(struct anner_sync *sync, struct anner_fence *fence);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <libdrm/drm_fourcc.h>
+
+#include "anner_target.h"
+#include "anner_format.h"
+#include "anner_memory.h"
+
+static void plane_destroy(struct anner_target_set *set, struct anner_target_plane *plane) {
+    if (plane->fbo)
+        glDeleteFramebuffers(1, &plane->fbo);
+    if (plane->texture)
+        glDeleteTextures(1, &plane->texture);
+    if (plane->image != EGL_NO_IMAGE_KHR)
+        set->destroy_image(set->dpy, plane->image);
+    memset(plane, 0, sizeof(*plane));
+}
+
+static int plane_create(struct anner_target_set *set, struct anner_target_plane *plane,
+                        const EGLint *attr, int fd) {
+    plane->image = set->create_image(set->dpy, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT,
+                                     (EGLClientBuffer)NULL, attr);
+    if (plane->image == EGL_NO_IMAGE_KHR) {
+        printf("anner_target: eglCreateImageKHR failed: 0x%04x\n", eglGetError());
+        return -1;
+    }
+
+    // keep unit 0 free for the input texture
+    glActiveTexture(GL_TEXTURE1);
+    glGenTextures(1, &plane->texture);
+    glBindTexture(GL_TEXTURE_2D, plane->texture);
+    set->image_target_texture_2d(GL_TEXTURE_2D, plane->image);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glActiveTexture(GL_TEXTURE0);
+
+    glGenFramebuffers(1, &plane->fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, plane->fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, plane->texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        printf("anner_target: fbo for fd %d is incomplete\n", fd);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        plane_destroy(set, plane);
+        return -1;
+    }
+    return 0;
+}
+
+/* NV12 as R8 luma at offset 0 and GR88 chroma (U in R, V in G) behind it */
+static int nv12_create(struct anner_target_set *set, struct anner_target *target,
+                       int fd, int w, int h, int stride) {
+    struct anner_format_layout layout;
+
+    anner_format_layout(DRM_FORMAT_NV12, w, h, stride, &layout);
+    EGLint luma[] = {
+        EGL_WIDTH, w,
+        EGL_HEIGHT, layout.heights[0],
+        EGL_LINUX_DRM_FOURCC_EXT, DRM_FORMAT_R8,
+        EGL_DMA_BUF_PLANE0_FD_EXT, fd,
+        EGL_DMA_BUF_PLANE0_OFFSET_EXT, layout.offsets[0],
+        EGL_DMA_BUF_PLANE0_PITCH_EXT, layout.pitches[0],
+        EGL_NONE
+    };
+    EGLint chroma[] = {
+        EGL_WIDTH, (w + 1) / 2,
+        EGL_HEIGHT, layout.heights[1],
+        EGL_LINUX_DRM_FOURCC_EXT, DRM_FORMAT_GR88,
+        EGL_DMA_BUF_PLANE0_FD_EXT, fd,
+        EGL_DMA_BUF_PLANE0_OFFSET_EXT, layout.offsets[1],
+        EGL_DMA_BUF_PLANE0_PITCH_EXT, layout.pitches[1],
+        EGL_NONE
+    };
+
+    if (plane_create(set, &target->planes[0], luma, fd) < 0)
+        return -1;
+    target->planes[0].effect = ANNER_PROGRAM_EFFECT_LUMA;
+    if (plane_create(set, &target->planes[1], chroma, fd) < 0) {
+        plane_destroy(set, &target->planes[0]);
+        return -1;
+    }
+    target->planes[1].effect = ANNER_PROGRAM_EFFECT_CHROMA;
+    target->planes[1].shift = 1;
+    target->plane_count = 2;
+    return 0;
+}
+
+int anner_target_set_init(struct anner_target_set *set, EGLDisplay dpy) {
+    memset(set, 0, sizeof(*set));
+    set->dpy = dpy;
+    set->current = -1;
+    set->create_image = (PFNEGLCREATEIMAGEKHRPROC) eglGetProcAddress("eglCreateImageKHR");
+    set->destroy_image = (PFNEGLDESTROYIMAGEKHRPROC) eglGetProcAddress("eglDestroyImageKHR");
+    set->image_target_texture_2d =
+        (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC) eglGetProcAddress("glEGLImageTargetTexture2DOES");
+    if (!set->create_image || !set->destroy_image || !set->image_target_texture_2d) {
+        printf("anner_target: EGL_KHR_image_base / GL_OES_EGL_image not available\n");
+        return -1;
+    }
+    return 0;
+}
+
+void anner_target_set_destroy(struct anner_target_set *set) {
+    for (int i = 0; i < ANNER_TARGET_MAX; i++) {
+        anner_target_remove(set, i);
+    }
+}
+
+int anner_target_find(struct anner_target_set *set, int fd) {
+    struct stat st;
+
+    if (fstat(fd, &st) < 0)
+        return -1;
+    for (int i = 0; i < ANNER_TARGET_MAX; i++) {
+        if (set->targets[i].used && set->targets[i].ino == (uint64_t)st.st_ino)
+            return i;
+    }
+    return -1;
+}
+
+int anner_target_add(struct anner_target_set *set, int fd, int w, int h,
+                     int stride, uint32_t format, const EGLint *attr) {
+    struct anner_format_layout layout;
+    struct anner_target *target = NULL;
+    struct stat st;
+    int ret;
+    int id;
+
+    if (!attr && format != DRM_FORMAT_NV12)
+        return -1;
+    if (fstat(fd, &st) < 0) {
+        printf("anner_target: fstat on fd %d failed\n", fd);
+        return -1;
+    }
+
+    id = anner_target_find(set, fd);
+    if (id >= 0) {
+        target = &set->targets[id];
+        if (target->w == w && target->h == h && target->stride == stride && target->format == format)
+            return id;
+        // same buffer with a new layout, import it again
+        anner_target_remove(set, id);
+    }
+
+    for (id = 0; id < ANNER_TARGET_MAX; id++) {
+        if (!set->targets[id].used)
+            break;
+    }
+    if (id == ANNER_TARGET_MAX) {
+        printf("anner_target: all %d targets are in use\n", ANNER_TARGET_MAX);
+        return -1;
+    }
+    target = &set->targets[id];
+
+    if (format == DRM_FORMAT_NV12) {
+        ret = nv12_create(set, target, fd, w, h, stride);
+    } else {
+        ret = plane_create(set, &target->planes[0], attr, fd);
+        target->planes[0].effect = ANNER_PROGRAM_EFFECT_NONE;
+        target->plane_count = 1;
+    }
+    if (ret < 0) {
+        memset(target, 0, sizeof(*target));
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        set->current = -1;
+        return -1;
+    }
+
+    target->used = 1;
+    target->ino = st.st_ino;
+    target->w = w;
+    target->h = h;
+    target->stride = stride;
+    target->format = format;
+    target->colorspace = ANNER_COLORSPACE_BT601;
+    target->size = anner_format_layout(format, w, h, stride, &layout) < 0 ?
+                   (size_t)stride * h : layout.size;
+    anner_memory_add(ANNER_MEMORY_TARGET, target->size);
+    set->current = id;
+    set->current_plane = target->plane_count - 1;
+    printf("anner_target: target %d fbo = %d planes = %d %dx%d\n", id,
+           target->planes[0].fbo, target->plane_count, w, h);
+    return id;
+}
+
+const struct anner_target *anner_target_get(struct anner_target_set *set, int id) {
+    if (id < 0 || id >= ANNER_TARGET_MAX || !set->targets[id].used)
+        return NULL;
+    return &set->targets[id];
+}
+
+int anner_target_bind(struct anner_target_set *set, int id) {
+    return anner_target_bind_plane(set, id, 0);
+}
+
+int anner_target_bind_plane(struct anner_target_set *set, int id, int plane) {
+    if (id >= 0 && (!anner_target_get(set, id) || plane < 0 ||
+                    plane >= set->targets[id].plane_count))
+        return -1;
+    if (id < 0)
+        plane = 0;
+    if (set->current == id && set->current_plane == plane)
+        return 0;
+    glBindFramebuffer(GL_FRAMEBUFFER, id >= 0 ? set->targets[id].planes[plane].fbo : 0);
+    set->current = id;
+    set->current_plane = plane;
+    return 0;
+}
+
+int anner_target_set_colorspace(struct anner_target_set *set, int id, int colorspace) {
+    if (!anner_target_get(set, id) || colorspace < 0 || colorspace >= ANNER_COLORSPACE_COUNT)
+        return -1;
+    set->targets[id].colorspace = colorspace;
+    return 0;
+}
+
+void anner_target_remove(struct anner_target_set *set, int id) {
+    struct anner_target *target;
+
+    if (id < 0 || id >= ANNER_TARGET_MAX || !set->targets[id].used)
+        return;
+    target = &set->targets[id];
+    if (set->current == id) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        set->current = -1;
+    }
+    for (int i = 0; i < target->plane_count; i++) {
+        plane_destroy(set, &target->planes[i]);
+    }
+    anner_memory_sub(ANNER_MEMORY_TARGET, target->size);
+    memset(target, 0, sizeof(*target));
+}
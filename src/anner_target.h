@@ -0,0 +1,95 @@
+#ifndef __ANNER_TARGET_H__
+#define __ANNER_TARGET_H__
+
+#include <stdint.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include "anner_program.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Render targets of an offscreen context.
+ *
+ * Every registered output dmabuf gets its own EGLImage, texture and FBO,
+ * so one context can render into a ring of outputs or into outputs of
+ * different sizes without being re-created. Targets are addressed by the
+ * id returned from anner_target_add().
+ *
+ * An NV12 output can not be rendered as a whole, it is split into an R8
+ * luma plane and a half resolution GR88 chroma plane, each with its own
+ * FBO, and a frame is drawn once per plane with the effect of the plane.
+ */
+
+#define ANNER_TARGET_MAX 32
+#define ANNER_TARGET_PLANES 2
+
+struct anner_target_plane {
+    EGLImageKHR image;
+    GLuint texture;
+    GLuint fbo;
+    int shift;          // log2 subsampling of the plane against the target size
+    uint32_t effect;    // program effect that fills the plane
+};
+
+struct anner_target {
+    int used;
+    uint64_t ino;       // dmabuf inode of the output buffer
+    int w;
+    int h;
+    int stride;
+    uint32_t format;
+    int colorspace;     // enum anner_colorspace, YUV outputs only
+    int plane_count;
+    struct anner_target_plane planes[ANNER_TARGET_PLANES];
+    size_t size;        // bytes of the output buffer, for anner_memory
+};
+
+struct anner_target_set {
+    EGLDisplay dpy;
+    struct anner_target targets[ANNER_TARGET_MAX];
+    int current;        // target bound as framebuffer, -1 for the window surface
+    int current_plane;
+    PFNEGLCREATEIMAGEKHRPROC create_image;
+    PFNEGLDESTROYIMAGEKHRPROC destroy_image;
+    PFNGLEGLIMAGETARGETTEXTURE2DOESPROC image_target_texture_2d;
+};
+
+int anner_target_set_init(struct anner_target_set *set, EGLDisplay dpy);
+void anner_target_set_destroy(struct anner_target_set *set);
+
+/*
+ * Register the output buffer behind fd, attr is its EGL_LINUX_DMA_BUF_EXT
+ * attribute list (unused for NV12, whose planes are imported one by one).
+ * Returns the target id; a buffer that is already registered returns its
+ * existing id. -1 on failure.
+ */
+int anner_target_add(struct anner_target_set *set, int fd, int w, int h,
+                     int stride, uint32_t format, const EGLint *attr);
+
+/* Target id of the buffer behind fd, -1 if it is not registered */
+int anner_target_find(struct anner_target_set *set, int fd);
+
+const struct anner_target *anner_target_get(struct anner_target_set *set, int id);
+
+/* Make id the current draw framebuffer, -1 binds the window surface */
+int anner_target_bind(struct anner_target_set *set, int id);
+
+/* Same as anner_target_bind() for one plane of the target */
+int anner_target_bind_plane(struct anner_target_set *set, int id, int plane);
+
+/* RGB -> YUV matrix used when rendering into a YUV target */
+int anner_target_set_colorspace(struct anner_target_set *set, int id, int colorspace);
+
+void anner_target_remove(struct anner_target_set *set, int id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -40,6 +40,21 @@
 #include <xf86drmMode.h>
 
 #include <anner_effects.h>
+#include <anner_program.h>
+#include <anner_import.h>
+#include <anner_sync.h>
+#include <anner_target.h>
+#include <anner_scaler.h>
+#include <anner_pool.h>
+#include <anner_modifier.h>
+#include <anner_format.h>
+#include <anner_ring.h>
+#include <anner_memory.h>
+#include <anner_hash.h>
+#include <anner_source.h>
+#include <anner_loader.h>
+#include <anner_readback.h>
+#include <anner_capture.h>
 
 #define IVI_SURFACE_ID 9000
 
@@ -93,60 +108,14 @@ static void checkGlError(const char* op) {
     }
 }
 
-// 2.0 vision
-/*static const char gVertexShader[] =
-      "attribute vec4 a_position;                 \n"
-      "attribute vec2 a_texCoord;                 \n"
-      "varying vec2 v_texCoord;                   \n"
-      "void main()                                \n"
-      "{                                          \n"
-      "   v_texCoord = a_texCoord;                \n"
-      "   gl_Position = a_position;               \n"
-      "}                                          \n";
-
-static const char gFragmentShader[] =
-      "precision mediump float;                            \n"
-      "varying vec2 v_texCoord;                            \n"
-      "uniform sampler2D s_texture;                        \n"
-      "void main()                                         \n"
-      "{                                                   \n"
-      "  gl_FragColor = texture2D( s_texture, v_texCoord );\n"
-      "}                                                   \n";
-*/
-
-static const char gVertexShader[] =
-      "#version 300 es                            \n"
-      "layout(location = 0) in vec4 a_position;   \n"
-      "layout(location = 1) in vec2 a_texCoord;   \n"
-      "out vec2 v_texCoord;                       \n"
-      "void main()                                \n"
-      "{                                          \n"
-      "   gl_Position = a_position;               \n"
-      "   v_texCoord = a_texCoord;                \n"
-      "}                                          \n";
-
-static const char gFragmentShader[] =
-      "#version 300 es                                     \n"
-      "precision mediump float;                            \n"
-      "in vec2 v_texCoord;                                 \n"
-      "layout(location = 0) out vec4 outColor;             \n"
-      "uniform sampler2D s_texture;                        \n"
-      "void main()                                         \n"
-      "{                                                   \n"
-      "  outColor = texture( s_texture, v_texCoord );      \n"
-      "}                                                   \n";
-
-GLuint gProgram;
-GLuint gvTextureSamplerHandle;
-GLuint Gtexture;
-GLuint Otexture;
 EGLBoolean returnValue;
 EGLConfig myConfig = {0};
 
-EGLint context_attribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+// the anner_program shaders are GLSL ES 3.00, which a strict ES 2 context does not compile
+EGLint context_attribs[] = { EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE };
 EGLint s_configAttribs[] = {
         EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
-        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT_KHR,
         EGL_NONE };
 
 EGLint majorVersion;
@@ -156,131 +125,93 @@ EGLSurface surface;
 EGLint surface_w, surface_h;
 
 EGLDisplay dpy;
-GLuint out_fbo_id = 0;
-
-uint32_t in_handle;
-uint32_t out_handle;  
-
-GLuint loadShader(GLenum shaderType, const char* pSource) {
-    GLuint shader = glCreateShader(shaderType);
-    if (shader) {
-        glShaderSource(shader, 1, &pSource, NULL);
-        glCompileShader(shader);
-        GLint compiled = 0;
-        glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
-        if (!compiled) {
-            GLint infoLen = 0;
-            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLen);
-            if (infoLen) {
-                char* buf = (char*) malloc(infoLen);
-                if (buf) {
-                    glGetShaderInfoLog(shader, infoLen, NULL, buf);
-                    fprintf(stderr, "Could not compile shader %d:\n%s\n",
-                            shaderType, buf);
-                    free(buf);
-                }
-                glDeleteShader(shader);
-                shader = 0;
-            }
-        }
-    }
-    return shader;
-}
-
-GLuint createProgram(const char* pVertexSource, const char* pFragmentSource) {
-    GLuint vertexShader = loadShader(GL_VERTEX_SHADER, pVertexSource);
-    if (!vertexShader) {
-        return 0;
-    }
 
-    GLuint pixelShader = loadShader(GL_FRAGMENT_SHADER, pFragmentSource);
-    if (!pixelShader) {
-        return 0;
-    }
-
-    GLuint program = glCreateProgram();
-    if (program) {
-        glAttachShader(program, vertexShader);
-        checkGlError("glAttachShader");
-        glAttachShader(program, pixelShader);
-        checkGlError("glAttachShader");
-        glLinkProgram(program);
-        GLint linkStatus = GL_FALSE;
-        glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
-        if (linkStatus != GL_TRUE) {
-            GLint bufLength = 0;
-            glGetProgramiv(program, GL_INFO_LOG_LENGTH, &bufLength);
-            if (bufLength) {
-                char* buf = (char*) malloc(bufLength);
-                if (buf) {
-                    glGetProgramInfoLog(program, bufLength, NULL, buf);
-                    fprintf(stderr, "Could not link program:\n%s\n", buf);
-                    free(buf);
-                }
-            }
-            glDeleteProgram(program);
-            program = 0;
-        }
-    }
-    return program;
-}
+static struct anner_pool pool;
 
-GLfloat gTriangleVertices[] = { -1.0f,  -1.0f, 0.0f,  // Position 0
-                                0.0f,  0.0f,        // TexCoord 0 
-                                -1.0f, 1.0f, 0.0f,  // Position 1
-                                0.0f,  1.0f,        // TexCoord 1
-                                1.0f, 1.0f, 0.0f,  // Position 2
-                                1.0f,  1.0f,        // TexCoord 2
-                                1.0f,  -1.0f, 0.0f,  // Position 3
-                                1.0f,  0.0f         // TexCoord 3
-                              };
+static struct anner_program_cache programs;
+static struct anner_import_cache imports;
+static struct anner_sync gpu_sync;
+static struct anner_target_set targets;
+static struct anner_scaler scaler;
+static struct anner_ring ring;
+static int ring_ready;
+static struct anner_readback readback;
+static int readback_ready;
+static int scale_mode;
 
-GLushort indices[] = { 0, 1, 2, 0, 2, 3 };
+static struct anner_input input;
+static struct anner_transform effects;
+static GLuint quad_vbo;
+static int in_w, in_h;
 
-static void
-set_glView(GLfloat *data, uint32_t width, uint32_t height, uint32_t angle)
-{
-    matrix_rotation(data, angle);
-    printf("set_glView w = %d h= %d angle = %d\n",width, height, angle);
-
-    glViewport(0, 0, width, height);
-
-}
-
-bool setupGraphics() {
-    gProgram = createProgram(gVertexShader, gFragmentShader);
-    if (!gProgram) {
-        return false;
-    }
-
-    gvTextureSamplerHandle = glGetUniformLocation(gProgram, "s_texture");
-    checkGlError("glGetAttribLocation");
-    //glViewport(0, 0, w, h);
-    glUseProgram(gProgram);
-    return true;
-}
+/*
+ * Frame deduplication: with it enabled the input is hashed on activation,
+ * and a render whose input content, effects and output match the previous
+ * render is skipped, the output still holds that frame.
+ */
+struct frame_key {
+    uint64_t input_hash;
+    struct anner_transform effects;
+    int scale_mode;
+    int target;
+    int colorspace;
+    int w;
+    int h;
+};
+
+static int dedup;
+static int input_hashed;        // input_hash describes the active input
+static uint64_t input_hash;
+static int last_frame_valid;
+static struct frame_key last_frame;
+static uint64_t skipped_frames;
 
 void renderFrame(int w, int h) {
-
-    glClearColor(0.0f, 0.0f, 1.0f, 1.0f);
-    checkGlError("glClearColor");
-    glClear( GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
-    checkGlError("glClear");
-
-    checkGlError("glUseProgram");
-    set_glView(gTriangleVertices, w, h, effects_angle);
-    glVertexAttribPointer ( 0, 3, GL_FLOAT,
-                           GL_FALSE, 5 * sizeof ( GLfloat ), gTriangleVertices );
-
-    glVertexAttribPointer ( 1, 2, GL_FLOAT,
-                           GL_FALSE, 5 * sizeof ( GLfloat ), &gTriangleVertices[3] );
-    glEnableVertexAttribArray (0);
-    glEnableVertexAttribArray (1);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, Gtexture);
-    glUniform1i (gvTextureSamplerHandle, 0);
-    glDrawElements (GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, indices );
-    checkGlError("glDrawElements");
+    const struct anner_target *target = anner_target_get(&targets, targets.current);
+    int planes = target ? target->plane_count : 1;
+    const struct anner_program *prog;
+    struct anner_scaler_source source;
+    GLfloat matrix[9];
+    GLfloat clip[4];
+    int src_w = in_w > 0 ? in_w : w;
+    int src_h = in_h > 0 ? in_h : h;
+    int levels;
+
+    anner_transform_matrix(&effects, src_w, src_h, matrix, clip);
+    printf("set_glView w = %d h= %d angle = %d\n", w, h, (int)effects.angle);
+    levels = anner_scaler_levels(scale_mode, matrix, src_w, src_h, w, h);
+    anner_scaler_prepare(&scaler, &programs, quad_vbo, scale_mode, &input,
+                         src_w, src_h, levels, &source);
+
+    // one pass per plane of the output: RGB has one, NV12 luma then chroma
+    for (int i = 0; i < planes; i++) {
+        uint32_t effect = target ? target->planes[i].effect : (uint32_t)ANNER_PROGRAM_EFFECT_NONE;
+        int shift = target ? target->planes[i].shift : 0;
+        int round = (1 << shift) - 1;   // subsampled planes keep the last column and row of odd sizes
+
+        if (target)
+            anner_target_bind_plane(&targets, targets.current, i);
+        glClearColor(0.0f, 0.0f, 1.0f, 1.0f);
+        checkGlError("glClearColor");
+        glClear( GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+        checkGlError("glClear");
+
+        prog = anner_program_use(&programs, ANNER_PROGRAM_KEY(source.input.program_format,
+                                                              source.input.program_sampler,
+                                                              effect, source.filter));
+        if (!prog) {
+            fprintf(stderr, "Could not set up graphics.\n");
+            exit(0);
+        }
+        anner_program_set_transform(prog, matrix, clip);
+        anner_program_set_texel(prog, source.w, source.h);
+        if (target)
+            anner_program_set_colorspace(prog, target->colorspace);
+        glViewport(0, 0, (w + round) >> shift, (h + round) >> shift);
+
+        anner_quad_draw(quad_vbo);
+        checkGlError("anner_quad_draw");
+    }
 }
 
 
@@ -316,83 +247,29 @@ int anner_dumpPixels(int len, int inWindowWidth, int inWindowHeight, unsigned ch
     return 0;
 }
 
-void *buf_alloc(int *fd, int Tex_w, int Tex_h, int type)
-{
-    struct drm_prime_handle fd_args;
-    struct drm_mode_map_dumb mmap_arg;
-    struct drm_mode_destroy_dumb destory_arg;
-    struct drm_mode_create_dumb alloc_arg;
-    static const char* card = "/dev/dri/card0";
-    int drm_fd = -1;
-    int flag = O_RDWR;
-    int ret;
-    void *map = NULL;
-
-    void *vir_addr = NULL;
-
-    drm_fd = open(card, flag);
-    if(drm_fd < 0)
-    {
-        printf("failed to open %s\n", card);
-        return NULL;
+int anner_dump_pixels_async(int w, int h, const char* file_name) {
+    if (!readback_ready) {
+        if (anner_readback_init(&readback) < 0)
+            return -1;
+        readback_ready = 1;
     }
+    return anner_readback_read(&readback, 0, 0, w, h, file_name);
+}
 
-    memset(&alloc_arg, 0, sizeof(alloc_arg));
-    alloc_arg.bpp = 32;
-    alloc_arg.width = Tex_w;
-    alloc_arg.height = Tex_h;
+int anner_dump_flush(void) {
+    return readback_ready ? anner_readback_flush(&readback) : 0;
+}
 
-    ret = drmIoctl(drm_fd, DRM_IOCTL_MODE_CREATE_DUMB, &alloc_arg);
-    if (ret) {
-        printf("failed to create dumb buffer: %s\n", strerror(errno));
-        return NULL;
-    }
+int anner_capture_output(void* capture, void* pixels, int drmbuf_fd) {
+    int ret;
 
-    memset(&fd_args, 0, sizeof(fd_args));
-    fd_args.fd = -1;
-    fd_args.handle = alloc_arg.handle;;
-    fd_args.flags = 0;
-    ret = drmIoctl(drm_fd, DRM_IOCTL_PRIME_HANDLE_TO_FD, &fd_args);
-    if (ret)
-    {
-        printf("rk-debug handle_to_fd failed ret=%d,err=%s, handle=%x \n",ret,strerror(errno),fd_args.handle);
-        return NULL;
-    }
-    printf("Dump fd = %d \n",fd_args.fd);
-    *fd = fd_args.fd;
-
-  //handle to Virtual address
-    memset(&mmap_arg, 0, sizeof(mmap_arg));
-    mmap_arg.handle = alloc_arg.handle;
-
-    ret = drmIoctl(drm_fd, DRM_IOCTL_MODE_MAP_DUMB, &mmap_arg);
-    if (ret) {
-        printf("failed to create map dumb: %s\n", strerror(errno));
-        vir_addr = NULL;
-        goto destory_dumb;
-    }
-    vir_addr = map = mmap64(0, alloc_arg.size, PROT_READ | PROT_WRITE, MAP_SHARED, drm_fd, mmap_arg.offset);
-    if (map == MAP_FAILED) {
-        printf("failed to mmap buffer: %s\n", strerror(errno));
-        vir_addr = NULL;
-        goto destory_dumb;
-    }
-    if (type == 0) {
-      in_handle = alloc_arg.handle;  
-    } else {
-      out_handle = alloc_arg.handle;    
-    }
-    printf("alloc map=%x \n",map);
-    return vir_addr;
-destory_dumb:
-  memset(&destory_arg, 0, sizeof(destory_arg));
-  destory_arg.handle = alloc_arg.handle;
-  int fdd = *fd;
-  ret = drmIoctl(drm_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destory_arg);
-  close(fdd);
-  if (ret)
-    printf("failed to destory dumb %d\n", ret);
-  return vir_addr;
+    if (!capture || !pixels)
+        return -1;
+    // the copy into a chunk is the only CPU access, the file is written from the chunk
+    anner_buffer_begin_cpu(drmbuf_fd, ANNER_BUFFER_READ);
+    ret = anner_capture_frame((struct anner_capture *)capture, pixels);
+    anner_buffer_end_cpu(drmbuf_fd, ANNER_BUFFER_READ);
+    return ret;
 }
 
 void anner_create_window(int window_width, int window_height) {
@@ -452,237 +329,487 @@ void anner_create_window(int window_width, int window_height) {
     checkEglError("eglQuerySurface");
 
     fprintf(stderr, "Window dimensions: %d x %d\n", surface_w, surface_h);
+    anner_program_cache_init(&programs);
+    anner_import_cache_init(&imports, dpy);
+    anner_sync_init(&gpu_sync, dpy);
+    anner_target_set_init(&targets, dpy);
+    // ANNER_ALLOC_DEVICE=/dev/udmabuf forces system memory buffers
+    anner_pool_init(&pool, getenv("ANNER_ALLOC_DEVICE"));
+    anner_scaler_init(&scaler);
+    anner_transform_init(&effects);
+    quad_vbo = anner_quad_create();
 }
 
-int anner_create_intput(void** pixels, int *drmbuf_fd, int w, int h, int format, int stride){
-
-    *pixels = buf_alloc(drmbuf_fd, w, h, 0);
-    printf("intput rk-debug [%d,%x] \n",*drmbuf_fd, *pixels);
+static int buffer_get(void** pixels, int *drmbuf_fd, int w, int h, int format, int stride) {
+    struct anner_buffer *buffer = anner_pool_acquire(&pool, w, h, stride, format);
 
+    if (!buffer) {
+        *pixels = NULL;
+        *drmbuf_fd = -1;
+        return -1;
+    }
+    *pixels = buffer->map;
+    *drmbuf_fd = buffer->fd;
     return 0;
 }
 
-static EGLint* choose_attr(int format, int is_afbc, int fd, int w, int h, int stride) {
-    EGLint* attr_out = (EGLint*)malloc(100);
-    //EGLint attr[100];
-    memset(attr_out, 0, sizeof(attr_out));
-    switch(format) {
-        case DRM_FORMAT_ABGR8888: {
-            EGLint attr[] = {
-                    EGL_WIDTH, w,
-                    EGL_HEIGHT, h,
-                    EGL_LINUX_DRM_FOURCC_EXT, DRM_FORMAT_ABGR8888,
-                    EGL_DMA_BUF_PLANE0_FD_EXT, fd,
-                    EGL_DMA_BUF_PLANE0_OFFSET_EXT, 0,
-                    EGL_DMA_BUF_PLANE0_PITCH_EXT, stride,
-                    is_afbc?EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT:EGL_NONE, is_afbc?((AFBC_FORMAT_MOD_SPARSE | AFBC_FORMAT_MOD_BLOCK_SIZE_16x16)&0xffffffff):EGL_NONE, //rk支持afbc默认格式
-                    is_afbc?EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT:EGL_NONE, is_afbc?(0x08<<24):EGL_NONE,  //ARM平台标志位
-                    EGL_NONE
-            };
-            memcpy(attr_out, attr, sizeof(attr));
-            break;
-        }
-        case DRM_FORMAT_RGB888: {
-            EGLint attr[] = {
-                    EGL_WIDTH, w,
-                    EGL_HEIGHT, h,
-                    EGL_LINUX_DRM_FOURCC_EXT, DRM_FORMAT_RGB888,
-                    EGL_DMA_BUF_PLANE0_FD_EXT, fd,
-                    EGL_DMA_BUF_PLANE0_OFFSET_EXT, 0,
-                    EGL_DMA_BUF_PLANE0_PITCH_EXT, stride,
-                    is_afbc?EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT:EGL_NONE, is_afbc?((AFBC_FORMAT_MOD_SPARSE | AFBC_FORMAT_MOD_BLOCK_SIZE_16x16)&0xffffffff):EGL_NONE, //rk支持afbc默认格式
-                    is_afbc?EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT:EGL_NONE, is_afbc?(0x08<<24):EGL_NONE,  //ARM平台标志位
-                    EGL_NONE
-            };
-            memcpy(attr_out, attr, sizeof(attr));
-            break;
-        }
-        case DRM_FORMAT_YUYV: {
-            EGLint attr[] = {
-                    EGL_WIDTH, w,
-                    EGL_HEIGHT, h,
-                    EGL_LINUX_DRM_FOURCC_EXT, DRM_FORMAT_YUYV,
-                    EGL_DMA_BUF_PLANE0_FD_EXT, fd,
-                    EGL_DMA_BUF_PLANE0_OFFSET_EXT, 0,
-                    EGL_DMA_BUF_PLANE0_PITCH_EXT, stride,
-                    is_afbc?EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT:EGL_NONE, is_afbc?((AFBC_FORMAT_MOD_SPARSE | AFBC_FORMAT_MOD_BLOCK_SIZE_16x16)&0xffffffff):EGL_NONE, //rk支持afbc默认格式
-                    is_afbc?EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT:EGL_NONE, is_afbc?(0x08<<24):EGL_NONE,  //ARM平台标志位
-                    EGL_NONE
-            };
-            memcpy(attr_out, attr, sizeof(attr));
-            break;
-        }
-        case DRM_FORMAT_YUV420_8BIT: {//该格式仅支持afbc，不支持linear
-            EGLint attr[] = {
-                    EGL_WIDTH, w,
-                    EGL_HEIGHT, h,
-                    EGL_LINUX_DRM_FOURCC_EXT, DRM_FORMAT_YUV420_8BIT,
-                    EGL_DMA_BUF_PLANE0_FD_EXT, fd,
-                    EGL_DMA_BUF_PLANE0_OFFSET_EXT, 0,
-                    EGL_DMA_BUF_PLANE0_PITCH_EXT, stride, //该格式afbc 无所谓stride 为1还是2
-                    is_afbc?EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT:EGL_NONE, is_afbc?((AFBC_FORMAT_MOD_SPARSE | AFBC_FORMAT_MOD_BLOCK_SIZE_16x16)&0xffffffff):EGL_NONE, //rk支持afbc默认格式
-                    is_afbc?EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT:EGL_NONE, is_afbc?(0x08<<24):EGL_NONE,  //ARM平台标志位
-                    EGL_NONE
-            };
-            memcpy(attr_out, attr, sizeof(attr));
-            break;
-        }
-        case DRM_FORMAT_NV12: {
-               EGLint* tmp;
-               if(!is_afbc)
-                {
-                EGLint attr[] = {
-                            EGL_WIDTH, w,
-                            EGL_HEIGHT, h,
-                            EGL_LINUX_DRM_FOURCC_EXT, DRM_FORMAT_NV12,
-                            EGL_DMA_BUF_PLANE0_FD_EXT, fd,
-                            EGL_DMA_BUF_PLANE0_OFFSET_EXT, 0,
-                            EGL_DMA_BUF_PLANE0_PITCH_EXT, stride,
-                            EGL_DMA_BUF_PLANE1_FD_EXT, fd,
-                            EGL_DMA_BUF_PLANE1_OFFSET_EXT, stride*h,
-                            EGL_DMA_BUF_PLANE1_PITCH_EXT, stride,
-                            EGL_NONE
-                    };
-                tmp = attr;
-                } else {
-                EGLint attr[] = {
-                            EGL_WIDTH, w,
-                            EGL_HEIGHT, h,
-                            EGL_LINUX_DRM_FOURCC_EXT, DRM_FORMAT_NV12,
-
-                            EGL_DMA_BUF_PLANE0_FD_EXT, fd,
-                            EGL_DMA_BUF_PLANE0_OFFSET_EXT, 0,
-                            EGL_DMA_BUF_PLANE0_PITCH_EXT, stride,
-                            EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT, ((AFBC_FORMAT_MOD_SPARSE | AFBC_FORMAT_MOD_BLOCK_SIZE_32x8)&0xffffffff), //rk支持afbc默认格式
-                            EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT, (0x08<<24),  //ARM平台标志位
-
-                            EGL_DMA_BUF_PLANE1_FD_EXT, fd,
-                            EGL_DMA_BUF_PLANE1_OFFSET_EXT, stride*h,
-                            EGL_DMA_BUF_PLANE1_PITCH_EXT, stride,
-                            EGL_DMA_BUF_PLANE1_MODIFIER_LO_EXT, ((AFBC_FORMAT_MOD_SPARSE | AFBC_FORMAT_MOD_BLOCK_SIZE_64x4)&0xffffffff), //rk支持afbc默认格式
-                            EGL_DMA_BUF_PLANE1_MODIFIER_HI_EXT, (0x08<<24),  //ARM平台标志位
-
-                            EGL_NONE
-                    };     
-                tmp = attr;  
-                }
-            memcpy(attr_out, tmp, sizeof(tmp));
-            break;
-        }
-        default:
-            printf("rk-debug[%s %d] error in_format unSupport:0x%x \n",__FUNCTION__,__LINE__,format);
+int anner_query_modifiers(int format, int render, uint64_t *modifiers, int max) {
+    return anner_modifier_query(dpy, format, render, modifiers, max);
+}
+
+/* Allocate from the modifiers both the GPU and the caller accept */
+static int buffer_get_modifiers(void** pixels, int *drmbuf_fd, int w, int h, int format, int render,
+                                const uint64_t *modifiers, int count, int *stride, uint64_t *modifier) {
+    uint64_t supported[ANNER_MODIFIER_MAX];
+    uint64_t common[ANNER_MODIFIER_MAX];
+    struct anner_buffer *buffer;
+    int n;
+
+    *pixels = NULL;
+    *drmbuf_fd = -1;
+    n = anner_modifier_query(dpy, format, render, supported, ANNER_MODIFIER_MAX);
+    if (modifiers)
+        n = anner_modifier_intersect(supported, n, modifiers, count, common, ANNER_MODIFIER_MAX);
+    else
+        memcpy(common, supported, n * sizeof(uint64_t));
+    if (n == 0) {
+        printf("rk-debug no modifier of format 0x%x is supported on both sides\n", format);
+        return -1;
     }
-    return attr_out;
+
+    buffer = anner_pool_acquire_modifiers(&pool, w, h, format, common, n);
+    if (!buffer)
+        return -1;
+    *pixels = buffer->map;
+    *drmbuf_fd = buffer->fd;
+    *stride = buffer->stride;
+    *modifier = buffer->modifier;
+    return 0;
+}
+
+int anner_create_intput_modifier(void** pixels, int *drmbuf_fd, int w, int h, int format,
+                                 const uint64_t *modifiers, int count, int *stride, uint64_t *modifier) {
+    if (buffer_get_modifiers(pixels, drmbuf_fd, w, h, format, 0, modifiers, count, stride, modifier) < 0)
+        return -1;
+    printf("intput rk-debug [%d,%p] modifier 0x%llx\n", *drmbuf_fd, *pixels,
+           (unsigned long long)*modifier);
+    return 0;
+}
+
+int anner_create_intput(void** pixels, int *drmbuf_fd, int w, int h, int format, int stride){
+
+    if (buffer_get(pixels, drmbuf_fd, w, h, format, stride) < 0)
+        return -1;
+    printf("intput rk-debug [%d,%x] \n",*drmbuf_fd, *pixels);
+
+    return 0;
 }
 
 int anner_create_output(void** pixels, int *drmbuf_fd, int w, int h, int format, int stride){
 
-    *pixels = buf_alloc(drmbuf_fd, w, h, 1);
-    EGLImageKHR img = NULL;
-    PFNGLEGLIMAGETARGETTEXTURE2DOESPROC image_target_texture_2d;
-    PFNEGLCREATEIMAGEKHRPROC create_image;
+    if (buffer_get(pixels, drmbuf_fd, w, h, format, stride) < 0)
+        return -1;
     printf("output rk-debug [%d,%x] \n",*drmbuf_fd, *pixels);
-    create_image = (PFNEGLCREATEIMAGEKHRPROC) eglGetProcAddress("eglCreateImageKHR");
-    image_target_texture_2d = (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC) eglGetProcAddress("glEGLImageTargetTexture2DOES");
     int out_fd = *drmbuf_fd;
     printf("anner_create_output w = %d h = %d stride = %d\n", w, h, stride);
-    EGLint* attr = choose_attr(format, 0, out_fd, w, h, stride);
+    EGLint* attr = anner_format_attr(format, DRM_FORMAT_MOD_LINEAR, out_fd, w, h, stride);
 
-    img = create_image(dpy, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, (EGLClientBuffer)NULL, attr);
-    ECHK(img);
-    if(img == EGL_NO_IMAGE_KHR)
-    {
-        printf("rk-debug eglCreateImageKHR NULL \n ");
-        return 0;
-    }
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glActiveTexture(GL_TEXTURE1);
-    glGenTextures(1, &Otexture);
-    glBindTexture(GL_TEXTURE_2D, Otexture);
-    image_target_texture_2d(GL_TEXTURE_2D, img);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-
-    glGenFramebuffers(1, &out_fbo_id);
-    glBindFramebuffer(GL_FRAMEBUFFER, out_fbo_id);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, Otexture, 0);
-    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE) {
-        printf("rk_debug create fbo success! fbo = %d\n", out_fbo_id);
-    } else {
+    int id = anner_target_add(&targets, out_fd, w, h, stride, format, attr);
+    free(attr);
+    if (id < 0) {
         printf("rk_debug create fbo failed!\n");
+        return -1;
     }
+    return id;
+}
 
+int anner_create_output_modifier(void** pixels, int *drmbuf_fd, int w, int h, int format,
+                                 const uint64_t *modifiers, int count, int *stride, uint64_t *modifier) {
+    uint64_t linear = DRM_FORMAT_MOD_LINEAR;
+    EGLint* attr;
+    int id;
+
+    // NV12 outputs are rendered per plane, which needs a linear layout
+    if (format == DRM_FORMAT_NV12) {
+        for (int i = 0; modifiers && i < count; i++) {
+            if (modifiers[i] == DRM_FORMAT_MOD_LINEAR)
+                modifiers = NULL;
+        }
+        if (modifiers) {
+            printf("rk-debug NV12 outputs must be linear\n");
+            return -1;
+        }
+        modifiers = &linear;
+        count = 1;
+    }
+    if (buffer_get_modifiers(pixels, drmbuf_fd, w, h, format, 1, modifiers, count, stride, modifier) < 0)
+        return -1;
+    printf("output rk-debug [%d,%p] modifier 0x%llx\n", *drmbuf_fd, *pixels,
+           (unsigned long long)*modifier);
+
+    attr = anner_format_attr(format, *modifier, *drmbuf_fd, w, h, *stride);
+    id = anner_target_add(&targets, *drmbuf_fd, w, h, *stride, format, attr);
     free(attr);
-    return 0;
+    if (id < 0) {
+        printf("rk_debug create fbo failed!\n");
+        return -1;
+    }
+    return id;
 }
 
-void anner_activation_texture(void* pixels, int drmbuf_fd, int w, int h, int format, int stride) {
-    EGLImageKHR img = NULL;
-    PFNGLEGLIMAGETARGETTEXTURE2DOESPROC image_target_texture_2d;
-
-    PFNEGLCREATEIMAGEKHRPROC create_image;
-    EGLint* attr = choose_attr(format, 0, drmbuf_fd, w, h, stride);
-    printf("in rk-debug [%d,%x] \n",drmbuf_fd, pixels);
-    create_image = (PFNEGLCREATEIMAGEKHRPROC) eglGetProcAddress("eglCreateImageKHR");
-    image_target_texture_2d = (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC) eglGetProcAddress("glEGLImageTargetTexture2DOES");
-
-    img = create_image(dpy, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, (EGLClientBuffer)NULL, attr);
-    ECHK(img);
-    if(img == EGL_NO_IMAGE_KHR)
-    {
-        printf("rk-debug eglCreateImageKHR NULL \n ");
+int anner_select_output(int output) {
+    return anner_target_bind(&targets, output);
+}
+
+int anner_set_output_colorspace(int output, int colorspace) {
+    return anner_target_set_colorspace(&targets, output, colorspace);
+}
+
+void anner_activation_texture_modifier(void* pixels, int drmbuf_fd, int w, int h, int format, int stride,
+                                       uint64_t modifier) {
+    struct anner_import_key key;
+    struct anner_format_layout layout;
+
+    input_hashed = 0;
+    if (anner_import_key_init(&key, drmbuf_fd, w, h, stride, format, modifier) < 0)
         return ;
+
+    // The producer cycles through a few dmabufs, reuse the EGLImage/texture of a known one
+    if (anner_import_input(&imports, &key, drmbuf_fd, &input) < 0) {
+        printf("rk-debug eglCreateImageKHR NULL [%d,%p] \n ", drmbuf_fd, pixels);
+        return ;
+    }
+    in_w = w;
+    in_h = h;
+
+    // only linear mappings can be hashed, the layout of a tiled one is unknown
+    if (dedup && pixels && modifier == DRM_FORMAT_MOD_LINEAR &&
+        anner_format_layout(format, w, h, stride, &layout) == 0) {
+        int shape[4] = { w, h, stride, (int)format };
+
+        anner_buffer_begin_cpu(drmbuf_fd, ANNER_BUFFER_READ);
+        input_hash = anner_hash64(pixels, layout.size, anner_hash64(shape, sizeof(shape), 0));
+        anner_buffer_end_cpu(drmbuf_fd, ANNER_BUFFER_READ);
+        input_hashed = 1;
     }
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glGenTextures(1, &Gtexture);
-    glBindTexture(GL_TEXTURE_2D, Gtexture);
-    image_target_texture_2d(GL_TEXTURE_2D, img);
+}
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    free(attr);
+void anner_activation_texture(void* pixels, int drmbuf_fd, int w, int h, int format, int stride) {
+    anner_activation_texture_modifier(pixels, drmbuf_fd, w, h, format, stride, DRM_FORMAT_MOD_LINEAR);
+}
+
+int anner_activate_frame(void* frames, int index, void* pixels, int drmbuf_fd, int stride) {
+    struct anner_source *source = (struct anner_source *)frames;
+    int ret;
+
+    if (!source)
+        return -1;
+    // a file mapping can not be imported, the frame is copied into the input buffer
+    anner_buffer_begin_cpu(drmbuf_fd, ANNER_BUFFER_WRITE);
+    ret = anner_source_copy(source, index, pixels, stride);
+    anner_buffer_end_cpu(drmbuf_fd, ANNER_BUFFER_WRITE);
+    if (ret < 0)
+        return -1;
+    anner_activation_texture(pixels, drmbuf_fd, source->w, source->h, source->format, stride);
+    return 0;
+}
+
+/* Loader filling pool inputs, activated without a further copy */
+struct input_loader {
+    struct anner_loader loader;
+    struct anner_buffer *buffers[ANNER_LOADER_MAX];
+    int count;
+    int held;           // slot of the active input, -1 if none
+};
+
+void anner_stop_loader(void* loader) {
+    struct input_loader *l = (struct input_loader *)loader;
+
+    if (!l)
+        return;
+    anner_loader_destroy(&l->loader);
+    for (int i = 0; i < l->count; i++) {
+        anner_import_release(&imports, l->buffers[i]->fd);
+        anner_pool_release(&pool, l->buffers[i]);
+    }
+    memset(&input, 0, sizeof(input));
+    input_hashed = 0;
+    free(l);
+}
+
+void* anner_start_loader(void* frames, int threads, int count) {
+    struct anner_source *source = (struct anner_source *)frames;
+    struct anner_loader_buffer buffers[ANNER_LOADER_MAX];
+    struct input_loader *l;
+
+    if (!source || count < 1 || count > ANNER_LOADER_MAX)
+        return NULL;
+    l = (struct input_loader *)calloc(1, sizeof(*l));
+    if (!l)
+        return NULL;
+    l->held = -1;
+    for (; l->count < count; l->count++) {
+        struct anner_buffer *buffer = anner_pool_acquire(&pool, source->w, source->h, 0, source->format);
+
+        if (!buffer)
+            break;
+        l->buffers[l->count] = buffer;
+        buffers[l->count].data = buffer->map;
+        buffers[l->count].stride = buffer->stride;
+        buffers[l->count].fd = buffer->fd;
+        buffers[l->count].begin_cpu = anner_buffer_begin_cpu;
+        buffers[l->count].end_cpu = anner_buffer_end_cpu;
+    }
+    if (l->count < count ||
+        anner_loader_init(&l->loader, source, threads, buffers, count) < 0) {
+        anner_stop_loader(l);
+        return NULL;
+    }
+    return l;
+}
+
+int anner_activate_loaded(void* loader, int timeout_ms) {
+    struct input_loader *l = (struct input_loader *)loader;
+    struct anner_source *source;
+    int frame;
+    int slot;
+
+    if (!l)
+        return -1;
+    source = l->loader.source;
+    // the previous input has been rendered, the workers may refill it
+    anner_loader_release(&l->loader, l->held);
+    l->held = -1;
+    slot = anner_loader_acquire(&l->loader, timeout_ms, &frame);
+    if (slot < 0)
+        return -1;
+    l->held = slot;
+    anner_activation_texture(l->buffers[slot]->map, l->buffers[slot]->fd, source->w, source->h,
+                             source->format, l->buffers[slot]->stride);
+    return frame;
 }
 
 void anner_set_effects(int Angle) {
-    effects_angle = Angle;
+    effects.angle = Angle;
+}
+
+void anner_set_transform(float angle, int flip_h, int flip_v,
+                         int crop_x, int crop_y, int crop_w, int crop_h, float scale) {
+    effects.angle = angle;
+    effects.flip_h = flip_h;
+    effects.flip_v = flip_v;
+    effects.crop_x = crop_x;
+    effects.crop_y = crop_y;
+    effects.crop_w = crop_w;
+    effects.crop_h = crop_h;
+    effects.scale = scale;
+}
+
+void anner_set_scaler(int mode) {
+    scale_mode = mode >= 0 && mode < ANNER_SCALER_COUNT ? mode : ANNER_SCALER_NEAREST;
+}
+
+/* 1 if rendering now would repeat the last frame, which is then counted as skipped */
+static int frame_repeats(int w, int h) {
+    const struct anner_target *target = anner_target_get(&targets, targets.current);
+    struct frame_key key;
+
+    if (!dedup || !input_hashed) {
+        last_frame_valid = 0;
+        return 0;
+    }
+    // memset so padding compares equal too
+    memset(&key, 0, sizeof(key));
+    key.input_hash = input_hash;
+    key.effects = effects;
+    key.scale_mode = scale_mode;
+    key.target = targets.current;
+    key.colorspace = target ? target->colorspace : -1;
+    key.w = w;
+    key.h = h;
+    if (last_frame_valid && !memcmp(&key, &last_frame, sizeof(key))) {
+        skipped_frames++;
+        return 1;
+    }
+    last_frame = key;
+    last_frame_valid = 1;
+    return 0;
+}
+
+void anner_set_dedup(int enable) {
+    dedup = enable;
+    input_hashed = 0;
+    last_frame_valid = 0;
+}
+
+uint64_t anner_get_skipped_frames(void) {
+    return skipped_frames;
 }
 
 void anner_render(int w, int h) {
-    if(!setupGraphics()) {
-        fprintf(stderr, "Could not set up graphics.\n");
-        exit(0);
+    // a repeat skips the draw, but an earlier async render of it may still be running
+    if (!frame_repeats(w, h))
+        renderFrame(w, h);
+    glFinish();
+}
+
+void* anner_render_async(int w, int h) {
+    struct anner_fence *fence;
+
+    // a repeat skips the draw, the fence still signals behind the earlier render of the frame
+    if (!frame_repeats(w, h))
+        renderFrame(w, h);
+    fence = (struct anner_fence *)malloc(sizeof(struct anner_fence));
+    if (!fence) {
+        glFinish();
+        return NULL;
+    }
+    if (anner_sync_fence_insert(&gpu_sync, fence) < 0) {
+        free(fence);
+        return NULL;
     }
+    return fence;
+}
+
+void anner_destroy_output_ring(void) {
+    if (!ring_ready)
+        return;
+    anner_ring_destroy(&ring);
+    ring_ready = 0;
+}
+
+int anner_create_output_ring(int count, int w, int h, int format, int stride) {
+    anner_destroy_output_ring();
+    if (anner_ring_init(&ring, &pool, &targets, &gpu_sync, count, w, h, stride, format) < 0)
+        return -1;
+    ring_ready = 1;
+    return 0;
+}
+
+int anner_render_ring(int w, int h) {
+    int slot;
+
+    if (!ring_ready)
+        return -1;
+    slot = anner_ring_begin(&ring);
+    if (slot < 0)
+        return -1;
+    // every slot is another output, the ring is never deduplicated
+    last_frame_valid = 0;
     renderFrame(w, h);
-    glFinish();
+    anner_ring_submit(&ring, slot);
+    return slot;
+}
+
+int anner_acquire_frame(int timeout_ms, void** pixels, int *drmbuf_fd) {
+    const struct anner_buffer *buffer;
+    int slot;
+
+    if (!ring_ready)
+        return -1;
+    slot = anner_ring_acquire(&ring, timeout_ms);
+    if (slot < 0)
+        return -1;
+    buffer = anner_ring_buffer(&ring, slot);
+    *pixels = buffer->map;
+    *drmbuf_fd = buffer->fd;
+    return slot;
+}
+
+void anner_release_frame(int slot) {
+    if (ring_ready)
+        anner_ring_release(&ring, slot);
+}
+
+int anner_wait_fence(void* fence, int timeout_ms) {
+    if (!fence)
+        return ANNER_FENCE_SIGNALED;
+    return anner_sync_fence_wait(&gpu_sync, (struct anner_fence *)fence, timeout_ms);
+}
+
+int anner_poll_fence(void* fence) {
+    if (!fence)
+        return ANNER_FENCE_SIGNALED;
+    return anner_sync_fence_poll(&gpu_sync, (struct anner_fence *)fence);
+}
+
+int anner_fence_fd(void* fence) {
+    return fence ? ((struct anner_fence *)fence)->fd : -1;
+}
+
+void anner_destroy_fence(void* fence) {
+    if (!fence)
+        return;
+    anner_sync_fence_destroy(&gpu_sync, (struct anner_fence *)fence);
+    free(fence);
 }
 
 int anner_disable_texture() {
-    glDeleteTextures(1, &Gtexture);
+    // the texture stays in the import cache until its buffer is deleted
+    memset(&input, 0, sizeof(input));
+    input_hashed = 0;
+    return 0;
+}
+
+int anner_begin_cpu_access(int drmbuf_fd, int flags) {
+    return anner_buffer_begin_cpu(drmbuf_fd, flags);
+}
+
+int anner_end_cpu_access(int drmbuf_fd, int flags) {
+    return anner_buffer_end_cpu(drmbuf_fd, flags);
+}
+
+int anner_get_memory_usage(int category, uint64_t *bytes, uint64_t *peak, int *count) {
+    struct anner_memory_stats stats;
+
+    if (anner_memory_get(category, &stats) < 0)
+        return -1;
+    *bytes = stats.bytes;
+    *peak = stats.peak;
+    *count = (int)stats.count;
+    return 0;
+}
+
+int anner_set_memory_budget(int category, uint64_t bytes) {
+    return anner_memory_set_budget(category, bytes);
 }
 
 int anner_delete_buf(void* pixels, int drm_fd, int len, int type) {
-    glDeleteTextures(1, &Gtexture);
-    glDeleteTextures(1, &Otexture);
-    if (pixels) {
-        munmap(pixels, len);
-    }
-    if (drm_fd) {
-        close(drm_fd);
-    }
+    struct anner_buffer *buffer;
 
-    struct drm_mode_destroy_dumb destory_arg;
-    memset(&destory_arg, 0, sizeof(destory_arg));
+    (void)len;      // the pool knows the size of its buffers
+    // a new buffer may get the same target id or content next
+    input_hashed = 0;
+    last_frame_valid = 0;
     if (type == 0) {
-        destory_arg.handle = in_handle;  
+        anner_import_release(&imports, drm_fd);
+        memset(&input, 0, sizeof(input));
     } else {
-        destory_arg.handle = out_handle;
-    } 
-    int ret = drmIoctl(drm_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destory_arg);
-    return ret;
+        anner_target_remove(&targets, anner_target_find(&targets, drm_fd));
+    }
+
+    // the pool keeps the mapping and fd for the next buffer of this size
+    buffer = anner_pool_find(&pool, drm_fd);
+    if (!buffer || buffer->map != pixels) {
+        printf("rk-debug delete of unknown buffer [%d,%p]\n", drm_fd, pixels);
+        return -1;
+    }
+    anner_pool_release(&pool, buffer);
+    return 0;
 }
 
 void anner_destory_window(void) {
+    if (readback_ready) {
+        anner_readback_destroy(&readback);
+        readback_ready = 0;
+    }
+    anner_destroy_output_ring();
+    anner_quad_destroy(quad_vbo);
+    anner_scaler_destroy(&scaler);
+    anner_target_set_destroy(&targets);
+    anner_import_cache_destroy(&imports);
+    anner_program_cache_destroy(&programs);
+    anner_pool_destroy(&pool);
     eglDestroyContext(dpy, context);
     eglDestroySurface(dpy, surface);
     eglTerminate(dpy);
@@ -17,6 +17,19 @@
 #include <unistd.h>
 #include <sys/time.h>
 
+#include <anner_effects.h>
+#include <anner_program.h>
+#include <anner_import.h>
+#include <anner_sync.h>
+#include <anner_target.h>
+#include <anner_scaler.h>
+#include <anner_pool.h>
+#include <anner_modifier.h>
+#include <anner_format.h>
+#include <anner_memory.h>
+
+#include "egl_impl.h"
+
 #define IVI_SURFACE_ID 9000
 
 #define ALIGN(_v, _d) (((_v) + ((_d) - 1)) & ~((_d) - 1))
@@ -56,10 +69,13 @@
 
 struct egl_ctx
 {
-    GLuint program;
-    GLuint gvTextureSamplerHandle;
-    GLuint Gtexture;
-    GLuint Otexture;
+    struct anner_program_cache programs;
+    struct anner_import_cache imports;
+    struct anner_sync sync;
+    struct anner_target_set targets;
+    struct anner_scaler scaler;
+    int scale_mode;
+    struct anner_input input;
     EGLConfig myConfig;
 
     EGLint majorVersion;
@@ -70,75 +86,20 @@ struct egl_ctx
     EGLint surface_h;
 
     EGLDisplay dpy;
-    GLfloat triangleVertices[20];
+    GLuint quad;
+    struct anner_transform transform;
+    int in_w;
+    int in_h;
     uint32_t format;
-    int out_fbo_id;
 };
 
-static const char gVertexShader[] =
-    "attribute vec4 a_position;                 \n"
-    "attribute vec2 a_texCoord;                 \n"
-    "varying vec2 v_texCoord;                   \n"
-    "void main()                                \n"
-    "{                                          \n"
-    "   v_texCoord = a_texCoord;                \n"
-    "   gl_Position = a_position;               \n"
-    "}                                          \n";
-
-static const char gFragmentShader[] =
-    "precision mediump float;                            \n"
-    "varying vec2 v_texCoord;                            \n"
-    "uniform sampler2D s_texture;                        \n"
-    "void main()                                         \n"
-    "{                                                   \n"
-    "  gl_FragColor = texture2D( s_texture, v_texCoord );\n"
-    "}                                                   \n";
-
-EGLint context_attribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+// the anner_program shaders are GLSL ES 3.00, which a strict ES 2 context does not compile
+EGLint context_attribs[] = { EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE };
 EGLint s_configAttribs[] = {
         EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
-        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT_KHR,
         EGL_NONE };
 
-static const GLfloat gTriangleVertices[] = {
-    -1.0f,  -1.0f,  0.0f,  // Position 0
-     0.0f,   0.0f,         // TexCoord 0
-    -1.0f,   1.0f,  0.0f,  // Position 1
-     0.0f,   1.0f,         // TexCoord 1
-     1.0f,   1.0f,  0.0f,  // Position 2
-     1.0f,   1.0f,         // TexCoord 2
-     1.0f,  -1.0f,  0.0f,  // Position 3
-     1.0f,   0.0f          // TexCoord 3
-};
-static const GLushort indices[] = { 0, 1, 2, 0, 2, 3 };
-
-static void initTriangleVertices(GLfloat *triangleVertices)
-{
-    memcpy(triangleVertices, &gTriangleVertices, sizeof(gTriangleVertices));
-}
-
-static void matrix_rotation(GLfloat *data, uint32_t angle)
-{
-    GLfloat ret = 0;
-
-    switch (angle) {
-    case 180:
-        ret = data[3]; data[3] = data[18]; data[18]=ret;
-        ret = data[4]; data[4] = data[19]; data[19]=ret;
-        ret = data[8]; data[8] = data[13]; data[13]=ret;
-        ret = data[9]; data[9] = data[14]; data[14]=ret;
-        break;
-    case 90:
-        ret = data[3]; data[3] = data[8]; data[8]=ret;
-        ret = data[4]; data[4] = data[9]; data[9]=ret;
-        ret = data[3]; data[3] = data[13]; data[13]=ret;
-        ret = data[4]; data[4] = data[14]; data[14]=ret;
-        ret = data[3]; data[3] = data[18]; data[18]=ret;
-        ret = data[4]; data[4] = data[19]; data[19]=ret;
-        break;
-    }
-}
-
 static void checkGlError(const char* op) {
     for (GLint error = glGetError(); error; error
             = glGetError()) {
@@ -153,111 +114,67 @@ static void checkEglError(const char* op) {
     }
 }
 
-static GLuint loadShader(GLenum shaderType, const char* pSource) {
-    GLuint shader = glCreateShader(shaderType);
-    if (shader) {
-        glShaderSource(shader, 1, &pSource, NULL);
-        glCompileShader(shader);
-        GLint compiled = 0;
-        glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
-        if (!compiled) {
-            GLint infoLen = 0;
-            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLen);
-            fprintf(stderr, "Could not compile shader %x:\n", shaderType);
-            if (infoLen) {
-                char* buf = (char*) malloc(infoLen);
-                if (buf) {
-                    glGetShaderInfoLog(shader, infoLen, NULL, buf);
-                    fprintf(stderr, "%s\n", buf);
-                    free(buf);
-                }
-                glDeleteShader(shader);
-                shader = 0;
-            }
-        }
-    }
-    return shader;
-}
-
-static GLuint createProgram(const char* pVertexSource, const char* pFragmentSource) {
-    GLuint vertexShader = loadShader(GL_VERTEX_SHADER, pVertexSource);
-    if (!vertexShader) {
-        return 0;
-    }
-
-    GLuint pixelShader = loadShader(GL_FRAGMENT_SHADER, pFragmentSource);
-    if (!pixelShader) {
-        return 0;
-    }
-
-    GLuint program = glCreateProgram();
-    if (program) {
-        glAttachShader(program, vertexShader);
-        checkGlError("glAttachShader");
-        glAttachShader(program, pixelShader);
-        checkGlError("glAttachShader");
-        glLinkProgram(program);
-        GLint linkStatus = GL_FALSE;
-        glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
-        if (linkStatus != GL_TRUE) {
-            GLint bufLength = 0;
-            glGetProgramiv(program, GL_INFO_LOG_LENGTH, &bufLength);
-            fprintf(stderr, "Could not link program:\n");
-            if (bufLength) {
-                char* buf = (char*) malloc(bufLength);
-                if (buf) {
-                    glGetProgramInfoLog(program, bufLength, NULL, buf);
-                    fprintf(stderr, "%s\n", buf);
-                    free(buf);
-                }
-            }
-            glDeleteProgram(program);
-            program = 0;
-        }
-    } else {
-        printf("create program faild\n");
-    }
-    return program;
-}
-
-static int setupGraphics(struct egl_ctx *ectx) {
-    ectx->program = createProgram(gVertexShader, gFragmentShader);
-    if (!ectx->program)
+/*
+ * Draw the current input into the current output, once per plane of the
+ * output: RGB has one, NV12 is drawn as luma and then half size chroma.
+ * The viewport is given in output pixels. -1 if a program is missing.
+ */
+static int drawPlanes(struct egl_ctx *ectx, int scale_mode, int x, int y, int w, int h,
+                      int in_w, int in_h, int angle, int clear) {
+    const struct anner_target *target = anner_target_get(&ectx->targets, ectx->targets.current);
+    int planes = target ? target->plane_count : 1;
+    struct anner_transform transform = ectx->transform;
+    struct anner_scaler_source source;
+    const struct anner_program *prog;
+    GLfloat matrix[9];
+    GLfloat clip[4];
+    int levels;
+    int i;
+
+    transform.angle = angle;
+    anner_transform_matrix(&transform, in_w, in_h, matrix, clip);
+    levels = anner_scaler_levels(scale_mode, matrix, in_w, in_h, w, h);
+    if (anner_scaler_prepare(&ectx->scaler, &ectx->programs, ectx->quad, scale_mode,
+                             &ectx->input, in_w, in_h, levels, &source) < 0)
         return -1;
 
-    ectx->gvTextureSamplerHandle = glGetUniformLocation(ectx->program, "s_texture");
-    checkGlError("glGetAttribLocation");
-    glUseProgram(ectx->program);
-
+    for (i = 0; i < planes; i++) {
+        uint32_t effect = target ? target->planes[i].effect : ANNER_PROGRAM_EFFECT_NONE;
+        int shift = target ? target->planes[i].shift : 0;
+        int round = (1 << shift) - 1;   // subsampled planes keep the last column and row of odd sizes
+
+        if (target)
+            anner_target_bind_plane(&ectx->targets, ectx->targets.current, i);
+        if (clear)
+            glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+
+        prog = anner_program_use(&ectx->programs, ANNER_PROGRAM_KEY(source.input.program_format,
+                                                                    source.input.program_sampler,
+                                                                    effect, source.filter));
+        if (!prog)
+            return -1;
+        anner_program_set_transform(prog, matrix, clip);
+        anner_program_set_texel(prog, source.w, source.h);
+        if (target)
+            anner_program_set_colorspace(prog, target->colorspace);
+        glViewport(x >> shift, y >> shift, ((x + w + round) >> shift) - (x >> shift),
+                   ((y + h + round) >> shift) - (y >> shift));
+        anner_quad_draw(ectx->quad);
+    }
     return 0;
 }
 
 static void renderFrame(struct egl_ctx *ectx, int w, int h, int angle) {
     glClearColor(0.0f, 0.0f, 1.0f, 1.0f);
     checkGlError("glClearColor");
-    glClear( GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
-    checkGlError("glClear");
 
-    checkGlError("glUseProgram");
-    matrix_rotation(ectx->triangleVertices, angle);
     printf("set_glView w = %d h= %d angle = %d\n", w, h, angle);
-    glViewport(0, 0, w, h);
-
-    glVertexAttribPointer ( 0, 3, GL_FLOAT,
-                           GL_FALSE, 5 * sizeof ( GLfloat ), ectx->triangleVertices );
-
-    glVertexAttribPointer ( 1, 2, GL_FLOAT,
-                           GL_FALSE, 5 * sizeof ( GLfloat ), &(ectx->triangleVertices[3]) );
-    glEnableVertexAttribArray (0);
-    glEnableVertexAttribArray (1);
-    glActiveTexture(GL_TEXTURE0);
-    checkGlError("glActiveTexture");
-    glBindTexture(GL_TEXTURE_2D, ectx->Gtexture);
-    checkGlError("glBindTexture");
-    glUniform1i (ectx->gvTextureSamplerHandle, 0);
-    checkGlError("glUniform1i");
-    glDrawElements (GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, indices );
-    checkGlError("glDrawElements");
+    if (drawPlanes(ectx, ectx->scale_mode, 0, 0, w, h, ectx->in_w > 0 ? ectx->in_w : w,
+                   ectx->in_h > 0 ? ectx->in_h : h, angle, 1) < 0) {
+        fprintf(stderr, "Could not set up graphics.\n");
+        exit(0);
+    }
+    checkGlError("anner_quad_draw");
 }
 
 void *ectx_create_window(int w, int h)
@@ -268,8 +185,8 @@ void *ectx_create_window(int w, int h)
     ectx = malloc(sizeof(struct egl_ctx));
     if (!ectx)
         return NULL;
-
-    initTriangleVertices(ectx->triangleVertices);
+    memset(ectx, 0, sizeof(struct egl_ctx));
+    anner_transform_init(&ectx->transform);
 
     checkEglError("<init>");
     ectx->dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
@@ -323,209 +240,257 @@ void *ectx_create_window(int w, int h)
     checkEglError("eglQuerySurface");
 
     fprintf(stderr, "Window dimensions: %d x %d\n", ectx->surface_w, ectx->surface_h);
+    anner_program_cache_init(&ectx->programs);
+    anner_import_cache_init(&ectx->imports, ectx->dpy);
+    anner_sync_init(&ectx->sync, ectx->dpy);
+    anner_target_set_init(&ectx->targets, ectx->dpy);
+    anner_scaler_init(&ectx->scaler);
+    ectx->quad = anner_quad_create();
 
     return (void *)ectx;
 }
 
-static EGLint* choose_attr(int format, int is_afbc, int fd, int w, int h, int stride) {
-    EGLint* attr_out = (EGLint*)malloc(100);
-    //EGLint attr[100];
-    memset(attr_out, 0, sizeof(attr_out));
-    switch(format) {
-        case DRM_FORMAT_ABGR8888: {
-            EGLint attr[] = {
-                    EGL_WIDTH, w,
-                    EGL_HEIGHT, h,
-                    EGL_LINUX_DRM_FOURCC_EXT, DRM_FORMAT_ABGR8888,
-                    EGL_DMA_BUF_PLANE0_FD_EXT, fd,
-                    EGL_DMA_BUF_PLANE0_OFFSET_EXT, 0,
-                    EGL_DMA_BUF_PLANE0_PITCH_EXT, stride,
-                    is_afbc?EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT:EGL_NONE, is_afbc?((AFBC_FORMAT_MOD_SPARSE | AFBC_FORMAT_MOD_BLOCK_SIZE_16x16)&0xffffffff):EGL_NONE, //rk支持afbc默认格式
-                    is_afbc?EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT:EGL_NONE, is_afbc?(0x08<<24):EGL_NONE,  //ARM平台标志位
-                    EGL_NONE
-            };
-            memcpy(attr_out, attr, sizeof(attr));
-            break;
-        }
-        case DRM_FORMAT_RGB888: {
-            EGLint attr[] = {
-                    EGL_WIDTH, w,
-                    EGL_HEIGHT, h,
-                    EGL_LINUX_DRM_FOURCC_EXT, DRM_FORMAT_RGB888,
-                    EGL_DMA_BUF_PLANE0_FD_EXT, fd,
-                    EGL_DMA_BUF_PLANE0_OFFSET_EXT, 0,
-                    EGL_DMA_BUF_PLANE0_PITCH_EXT, stride,
-                    is_afbc?EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT:EGL_NONE, is_afbc?((AFBC_FORMAT_MOD_SPARSE | AFBC_FORMAT_MOD_BLOCK_SIZE_16x16)&0xffffffff):EGL_NONE, //rk支持afbc默认格式
-                    is_afbc?EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT:EGL_NONE, is_afbc?(0x08<<24):EGL_NONE,  //ARM平台标志位
-                    EGL_NONE
-            };
-            memcpy(attr_out, attr, sizeof(attr));
-            break;
-        }
-        case DRM_FORMAT_YUYV: {
-            EGLint attr[] = {
-                    EGL_WIDTH, w,
-                    EGL_HEIGHT, h,
-                    EGL_LINUX_DRM_FOURCC_EXT, DRM_FORMAT_YUYV,
-                    EGL_DMA_BUF_PLANE0_FD_EXT, fd,
-                    EGL_DMA_BUF_PLANE0_OFFSET_EXT, 0,
-                    EGL_DMA_BUF_PLANE0_PITCH_EXT, stride,
-                    is_afbc?EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT:EGL_NONE, is_afbc?((AFBC_FORMAT_MOD_SPARSE | AFBC_FORMAT_MOD_BLOCK_SIZE_16x16)&0xffffffff):EGL_NONE, //rk支持afbc默认格式
-                    is_afbc?EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT:EGL_NONE, is_afbc?(0x08<<24):EGL_NONE,  //ARM平台标志位
-                    EGL_NONE
-            };
-            memcpy(attr_out, attr, sizeof(attr));
-            break;
-        }
-        case DRM_FORMAT_YUV420_8BIT: {//该格式仅支持afbc，不支持linear
-            EGLint attr[] = {
-                    EGL_WIDTH, w,
-                    EGL_HEIGHT, h,
-                    EGL_LINUX_DRM_FOURCC_EXT, DRM_FORMAT_YUV420_8BIT,
-                    EGL_DMA_BUF_PLANE0_FD_EXT, fd,
-                    EGL_DMA_BUF_PLANE0_OFFSET_EXT, 0,
-                    EGL_DMA_BUF_PLANE0_PITCH_EXT, stride, //该格式afbc 无所谓stride 为1还是2
-                    is_afbc?EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT:EGL_NONE, is_afbc?((AFBC_FORMAT_MOD_SPARSE | AFBC_FORMAT_MOD_BLOCK_SIZE_16x16)&0xffffffff):EGL_NONE, //rk支持afbc默认格式
-                    is_afbc?EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT:EGL_NONE, is_afbc?(0x08<<24):EGL_NONE,  //ARM平台标志位
-                    EGL_NONE
-            };
-            memcpy(attr_out, attr, sizeof(attr));
-            break;
-        }
-        case DRM_FORMAT_NV12: {
-               EGLint* tmp;
-               if(!is_afbc)
-                {
-                EGLint attr[] = {
-                            EGL_WIDTH, w,
-                            EGL_HEIGHT, h,
-                            EGL_LINUX_DRM_FOURCC_EXT, DRM_FORMAT_NV12,
-                            EGL_DMA_BUF_PLANE0_FD_EXT, fd,
-                            EGL_DMA_BUF_PLANE0_OFFSET_EXT, 0,
-                            EGL_DMA_BUF_PLANE0_PITCH_EXT, stride,
-                            EGL_DMA_BUF_PLANE1_FD_EXT, fd,
-                            EGL_DMA_BUF_PLANE1_OFFSET_EXT, stride*h,
-                            EGL_DMA_BUF_PLANE1_PITCH_EXT, stride,
-                            EGL_NONE
-                    };
-                tmp = attr;
-                } else {
-                EGLint attr[] = {
-                            EGL_WIDTH, w,
-                            EGL_HEIGHT, h,
-                            EGL_LINUX_DRM_FOURCC_EXT, DRM_FORMAT_NV12,
-
-                            EGL_DMA_BUF_PLANE0_FD_EXT, fd,
-                            EGL_DMA_BUF_PLANE0_OFFSET_EXT, 0,
-                            EGL_DMA_BUF_PLANE0_PITCH_EXT, stride,
-                            EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT, ((AFBC_FORMAT_MOD_SPARSE | AFBC_FORMAT_MOD_BLOCK_SIZE_32x8)&0xffffffff), //rk支持afbc默认格式
-                            EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT, (0x08<<24),  //ARM平台标志位
-
-                            EGL_DMA_BUF_PLANE1_FD_EXT, fd,
-                            EGL_DMA_BUF_PLANE1_OFFSET_EXT, stride*h,
-                            EGL_DMA_BUF_PLANE1_PITCH_EXT, stride,
-                            EGL_DMA_BUF_PLANE1_MODIFIER_LO_EXT, ((AFBC_FORMAT_MOD_SPARSE | AFBC_FORMAT_MOD_BLOCK_SIZE_64x4)&0xffffffff), //rk支持afbc默认格式
-                            EGL_DMA_BUF_PLANE1_MODIFIER_HI_EXT, (0x08<<24),  //ARM平台标志位
-
-                            EGL_NONE
-                    };     
-                tmp = attr;  
-                }
-            memcpy(attr_out, tmp, sizeof(tmp));
-            break;
-        }
-        default:
-            printf("rk-debug[%s %d] error in_format unSupport:0x%x \n",__FUNCTION__,__LINE__,format);
-    }
-    return attr_out;
+int ectx_query_modifiers(void *_ectx, int format, int render, uint64_t *modifiers, int max) {
+    struct egl_ctx *ectx = (struct egl_ctx *)_ectx;
+
+    return anner_modifier_query(ectx->dpy, format, render, modifiers, max);
 }
 
 int ectx_activation_texture(void *_ectx, int drmbuf_fd,
                             int w, int h, int stride, int format) {
-    struct egl_ctx *ectx = (struct egl_ctx *)_ectx;
-    EGLImageKHR img = NULL;
-    PFNGLEGLIMAGETARGETTEXTURE2DOESPROC image_target_texture_2d;
+    return ectx_activation_texture_modifier(_ectx, drmbuf_fd, w, h, stride, format,
+                                            DRM_FORMAT_MOD_LINEAR);
+}
 
-    PFNEGLCREATEIMAGEKHRPROC create_image;
-    EGLint* attr = choose_attr(format, 0, drmbuf_fd, w, h, stride);
+int ectx_activation_texture_modifier(void *_ectx, int drmbuf_fd, int w, int h,
+                                     int stride, int format, uint64_t modifier) {
+    struct egl_ctx *ectx = (struct egl_ctx *)_ectx;
+    struct anner_import_key key;
 
     ectx->format = format;
-    create_image = (PFNEGLCREATEIMAGEKHRPROC) eglGetProcAddress("eglCreateImageKHR");
-    image_target_texture_2d =
-        (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC) eglGetProcAddress("glEGLImageTargetTexture2DOES");
-
-    img = create_image(ectx->dpy, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, (EGLClientBuffer)NULL, attr);
-    ECHK(img);
-    if(img == EGL_NO_IMAGE_KHR)
-    {
+    if (anner_import_key_init(&key, drmbuf_fd, w, h, stride, format, modifier) < 0)
+        return -1;
+
+    if (anner_import_input(&ectx->imports, &key, drmbuf_fd, &ectx->input) < 0) {
         printf("rk-debug eglCreateImageKHR NULL \n ");
         return -1;
     }
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glGenTextures(1, &ectx->Gtexture);
-    glBindTexture(GL_TEXTURE_2D, ectx->Gtexture);
-    image_target_texture_2d(GL_TEXTURE_2D, img);
+    ectx->in_w = w;
+    ectx->in_h = h;
+    return 0;
+}
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    free(attr);
+void ectx_set_transform(void *_ectx, int flip_h, int flip_v,
+                        int crop_x, int crop_y, int crop_w, int crop_h, float scale) {
+    struct egl_ctx *ectx = (struct egl_ctx *)_ectx;
+
+    ectx->transform.flip_h = flip_h;
+    ectx->transform.flip_v = flip_v;
+    ectx->transform.crop_x = crop_x;
+    ectx->transform.crop_y = crop_y;
+    ectx->transform.crop_w = crop_w;
+    ectx->transform.crop_h = crop_h;
+    ectx->transform.scale = scale;
+}
+
+void ectx_set_scaler(void *_ectx, int mode) {
+    struct egl_ctx *ectx = (struct egl_ctx *)_ectx;
+
+    ectx->scale_mode = mode >= 0 && mode < ANNER_SCALER_COUNT ? mode : ANNER_SCALER_NEAREST;
+}
+
+void ectx_release_buffer(void *_ectx, int drmbuf_fd) {
+    struct egl_ctx *ectx = (struct egl_ctx *)_ectx;
+
+    anner_import_release(&ectx->imports, drmbuf_fd);
+    memset(&ectx->input, 0, sizeof(ectx->input));
+}
+
+int ectx_begin_cpu_access(int drmbuf_fd, int flags) {
+    return anner_buffer_begin_cpu(drmbuf_fd, flags);
+}
+
+int ectx_end_cpu_access(int drmbuf_fd, int flags) {
+    return anner_buffer_end_cpu(drmbuf_fd, flags);
+}
+
+int ectx_get_memory_usage(int category, uint64_t *bytes, uint64_t *peak, int *count) {
+    struct anner_memory_stats stats;
+
+    if (anner_memory_get(category, &stats) < 0)
+        return -1;
+    *bytes = stats.bytes;
+    *peak = stats.peak;
+    *count = (int)stats.count;
     return 0;
 }
 
+int ectx_set_memory_budget(int category, uint64_t bytes) {
+    return anner_memory_set_budget(category, bytes);
+}
+
 int ectx_import_output(void *_ectx, int drmbuf_fd,
                        int w, int h, int stride, int format) {
+    return ectx_import_output_modifier(_ectx, drmbuf_fd, w, h, stride, format,
+                                       DRM_FORMAT_MOD_LINEAR);
+}
+
+int ectx_import_output_modifier(void *_ectx, int drmbuf_fd, int w, int h,
+                                int stride, int format, uint64_t modifier) {
     struct egl_ctx *ectx = (struct egl_ctx *)_ectx;
-    EGLImageKHR img = NULL;
-    PFNGLEGLIMAGETARGETTEXTURE2DOESPROC image_target_texture_2d;
-    PFNEGLCREATEIMAGEKHRPROC create_image;
-    int out_fd = drmbuf_fd;
-    EGLint* attr = choose_attr(format, 0, out_fd, w, h, stride);
-
-    create_image = (PFNEGLCREATEIMAGEKHRPROC) eglGetProcAddress("eglCreateImageKHR");
-    image_target_texture_2d = (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC) eglGetProcAddress("glEGLImageTargetTexture2DOES");
-
-    img = create_image(ectx->dpy, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, (EGLClientBuffer)NULL, attr);
-    ECHK(img);
-    if(img == EGL_NO_IMAGE_KHR)
-    {
-        printf("rk-debug eglCreateImageKHR NULL \n ");
-        return 0;
-    }
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glActiveTexture(GL_TEXTURE1);
-    glGenTextures(1, &ectx->Otexture);
-    glBindTexture(GL_TEXTURE_2D, ectx->Otexture);
-    image_target_texture_2d(GL_TEXTURE_2D, img);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-
-    glGenFramebuffers(1, &ectx->out_fbo_id);
-    glBindFramebuffer(GL_FRAMEBUFFER, ectx->out_fbo_id);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ectx->Otexture, 0);
-    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE) {
-        printf("rk_debug create fbo success! fbo = %d\n", ectx->out_fbo_id);
-    } else {
-        printf("rk_debug create fbo failed!\n");
+    EGLint* attr;
+    int id;
+
+    if (format == DRM_FORMAT_NV12 && modifier != DRM_FORMAT_MOD_LINEAR) {
+        printf("rk_debug NV12 outputs are rendered per plane and must be linear\n");
+        return -1;
     }
+    attr = anner_format_attr(format, modifier, drmbuf_fd, w, h, stride);
+    id = anner_target_add(&ectx->targets, drmbuf_fd, w, h, stride, format, attr);
     free(attr);
-    return 0;
+    if (id < 0)
+        printf("rk_debug create fbo failed!\n");
+    return id;
+}
+
+int ectx_select_output(void *_ectx, int output) {
+    struct egl_ctx *ectx = (struct egl_ctx *)_ectx;
+
+    return anner_target_bind(&ectx->targets, output);
+}
+
+int ectx_set_output_colorspace(void *_ectx, int output, int colorspace) {
+    struct egl_ctx *ectx = (struct egl_ctx *)_ectx;
+
+    return anner_target_set_colorspace(&ectx->targets, output, colorspace);
+}
+
+void ectx_release_output(void *_ectx, int output) {
+    struct egl_ctx *ectx = (struct egl_ctx *)_ectx;
+
+    anner_target_remove(&ectx->targets, output);
 }
 
 void ectx_render(void *_ectx, int w, int h, int angle) {
     struct egl_ctx *ectx = (struct egl_ctx *)_ectx;
-    if(setupGraphics(_ectx) == -1) {
-        fprintf(stderr, "Could not set up graphics.\n");
-        exit(0);
-    }
     renderFrame(ectx, w, h, angle);
     glFinish();
 }
 
+void *ectx_render_async(void *_ectx, int w, int h, int angle) {
+    struct egl_ctx *ectx = (struct egl_ctx *)_ectx;
+    struct anner_fence *fence;
+
+    renderFrame(ectx, w, h, angle);
+    fence = malloc(sizeof(struct anner_fence));
+    if (!fence) {
+        glFinish();
+        return NULL;
+    }
+    if (anner_sync_fence_insert(&ectx->sync, fence) < 0) {
+        free(fence);
+        return NULL;
+    }
+    return fence;
+}
+
+void *ectx_render_batch(void *_ectx, const struct ectx_job *jobs, int count) {
+    struct egl_ctx *ectx = (struct egl_ctx *)_ectx;
+    struct anner_fence *fence;
+    int cleared[ANNER_TARGET_MAX];
+    int i;
+
+    memset(cleared, 0, sizeof(cleared));
+    glClearColor(0.0f, 0.0f, 1.0f, 1.0f);
+
+    for (i = 0; i < count; i++) {
+        const struct ectx_job *job = &jobs[i];
+        const struct anner_target *target;
+        int scale_mode;
+        int out;
+
+        out = anner_target_find(&ectx->targets, job->out_fd);
+        if (out < 0)
+            out = ectx_import_output(ectx, job->out_fd, job->out_w, job->out_h,
+                                     job->out_stride, job->out_format);
+        if (out < 0 || ectx_activation_texture(ectx, job->in_fd, job->in_w, job->in_h,
+                                               job->in_stride, job->in_format) < 0) {
+            printf("ectx_render_batch: skip job %d\n", i);
+            continue;
+        }
+        target = anner_target_get(&ectx->targets, out);
+        anner_target_bind(&ectx->targets, out);
+
+        scale_mode = job->scaler >= 0 && job->scaler < ANNER_SCALER_COUNT ?
+                     job->scaler : ANNER_SCALER_NEAREST;
+
+        // each output is cleared once per batch so jobs may share an output
+        if (job->w > 0 && job->h > 0) {
+            if (drawPlanes(ectx, scale_mode, job->x, job->y, job->w, job->h, job->in_w, job->in_h,
+                           job->angle, !cleared[out]) < 0)
+                printf("ectx_render_batch: no program for job %d\n", i);
+        } else {
+            if (drawPlanes(ectx, scale_mode, 0, 0, target->w, target->h, job->in_w, job->in_h,
+                           job->angle, !cleared[out]) < 0)
+                printf("ectx_render_batch: no program for job %d\n", i);
+        }
+        cleared[out] = 1;
+    }
+    checkGlError("ectx_render_batch");
+
+    fence = malloc(sizeof(struct anner_fence));
+    if (!fence) {
+        glFinish();
+        return NULL;
+    }
+    if (anner_sync_fence_insert(&ectx->sync, fence) < 0) {
+        free(fence);
+        return NULL;
+    }
+    return fence;
+}
+
+int ectx_fence_wait(void *_ectx, void *_fence, int timeout_ms) {
+    struct egl_ctx *ectx = (struct egl_ctx *)_ectx;
+    struct anner_fence *fence = (struct anner_fence *)_fence;
+
+    if (!fence)
+        return ANNER_FENCE_SIGNALED;
+    return anner_sync_fence_wait(&ectx->sync, fence, timeout_ms);
+}
+
+int ectx_fence_poll(void *_ectx, void *_fence) {
+    struct egl_ctx *ectx = (struct egl_ctx *)_ectx;
+    struct anner_fence *fence = (struct anner_fence *)_fence;
+
+    if (!fence)
+        return ANNER_FENCE_SIGNALED;
+    return anner_sync_fence_poll(&ectx->sync, fence);
+}
+
+int ectx_fence_fd(void *_fence) {
+    struct anner_fence *fence = (struct anner_fence *)_fence;
+
+    return fence ? fence->fd : -1;
+}
+
+void ectx_fence_destroy(void *_ectx, void *_fence) {
+    struct egl_ctx *ectx = (struct egl_ctx *)_ectx;
+    struct anner_fence *fence = (struct anner_fence *)_fence;
+
+    if (!fence)
+        return;
+    anner_sync_fence_destroy(&ectx->sync, fence);
+    free(fence);
+}
+
 void ectx_destory_window(void *_ectx) {
     struct egl_ctx *ectx = (struct egl_ctx *)_ectx;
-    glDeleteTextures(1, &ectx->Gtexture);
-    glDeleteTextures(1, &ectx->Otexture);
+    anner_quad_destroy(ectx->quad);
+    anner_scaler_destroy(&ectx->scaler);
+    anner_target_set_destroy(&ectx->targets);
+    anner_import_cache_destroy(&ectx->imports);
+    anner_program_cache_destroy(&ectx->programs);
     eglDestroyContext(ectx->dpy, ectx->context);
     eglDestroySurface(ectx->dpy, ectx->surface);
     eglTerminate(ectx->dpy);
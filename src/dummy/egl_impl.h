@@ -1,13 +1,107 @@
 #ifndef __EGL_IMPL_H__
 #define __EGL_IMPL_H__
 
+#include <stdint.h>
+
 void *ectx_create_window(int w, int h);
 void ectx_destory_window(void *_impl);
+/*
+ * Register an output buffer, returns its output id (-1 on failure).
+ * The newly imported output becomes the render target; one context can
+ * hold several outputs and switch between them with ectx_select_output().
+ */
 int ectx_import_output(void *_impl, int drmbuf_fd,
                        int w, int h, int stride, int format);
+int ectx_select_output(void *_impl, int output);
+/*
+ * NV12 outputs are drawn in two passes, luma and half resolution chroma.
+ * colorspace picks the RGB -> YUV matrix: 0 = BT.601 (default), 1 = BT.709,
+ * both limited range. Ignored for RGB outputs.
+ */
+int ectx_set_output_colorspace(void *_impl, int output, int colorspace);
+void ectx_release_output(void *_impl, int output);
 int ectx_activation_texture(void *_impl, int drmbuf_fd,
                             int w, int h, int stride, int format);
+void ectx_release_buffer(void *_impl, int drmbuf_fd);
+/*
+ * Format modifiers the GPU imports format (DRM fourcc) with, as an output
+ * when render is set, linear always included. Allocate the buffer from the
+ * modifiers its other user (display, decoder) supports too, then import it
+ * with the _modifier variants; AFBC keeps the buffer compressed end to end.
+ * Returns the number of modifiers written. NV12 outputs must be linear.
+ */
+int ectx_query_modifiers(void *_impl, int format, int render, uint64_t *modifiers, int max);
+int ectx_import_output_modifier(void *_impl, int drmbuf_fd, int w, int h,
+                                int stride, int format, uint64_t modifier);
+int ectx_activation_texture_modifier(void *_impl, int drmbuf_fd, int w, int h,
+                                     int stride, int format, uint64_t modifier);
+/*
+ * Bracket CPU reads/writes of a mapped buffer (DMA_BUF_IOCTL_SYNC) so that
+ * cached mappings stay coherent with the GPU. flags: what the CPU does.
+ */
+#define ECTX_CPU_READ   1
+#define ECTX_CPU_WRITE  2
+int ectx_begin_cpu_access(int drmbuf_fd, int flags);
+int ectx_end_cpu_access(int drmbuf_fd, int flags);
+/*
+ * Process-wide accounting of what every context holds, current and peak
+ * bytes and live count per category. Imports and targets are views of
+ * dmabufs and overlap with the buffers. A budget (0 = none) makes the
+ * caches evict idle buffers and least recently used imports; a new buffer
+ * that still does not fit fails. -1 for an unknown category.
+ */
+#define ECTX_MEMORY_BUFFERS 0
+#define ECTX_MEMORY_IMPORTS 1
+#define ECTX_MEMORY_TARGETS 2
+#define ECTX_MEMORY_SCALER  3
+int ectx_get_memory_usage(int category, uint64_t *bytes, uint64_t *peak, int *count);
+int ectx_set_memory_budget(int category, uint64_t bytes);
+/*
+ * Input filtering of ectx_render(): 0 nearest (default), 1 bilinear,
+ * 2 bicubic, 3 Lanczos. Except for nearest, reductions of 2x and more
+ * first go through at most 3 box-filtered half size passes.
+ */
+void ectx_set_scaler(void *_impl, int mode);
+/*
+ * Flip, crop (input pixels, 0 size = whole input) and zoom applied by every
+ * following render; the rotation angle is passed per render call.
+ */
+void ectx_set_transform(void *_impl, int flip_h, int flip_v,
+                        int crop_x, int crop_y, int crop_w, int crop_h, float scale);
 void ectx_render(void *_impl, int w, int h, int angle);
 
+/*
+ * Asynchronous render: returns a fence right after submission instead of
+ * blocking in glFinish(). The fence must be released with ectx_fence_destroy().
+ * wait/poll return 0 when the GPU is done, 1 on timeout, -1 on error.
+ * ectx_fence_fd() is a sync_file fd owned by the fence, or -1.
+ */
+void *ectx_render_async(void *_impl, int w, int h, int angle);
+int ectx_fence_wait(void *_impl, void *fence, int timeout_ms);
+int ectx_fence_poll(void *_impl, void *fence);
+int ectx_fence_fd(void *fence);
+void ectx_fence_destroy(void *_impl, void *fence);
+
+/*
+ * One transform job of a batch. Input and output buffers are imported on
+ * first use and stay cached in the context. The viewport is a rectangle
+ * inside the output, w/h of 0 means the whole output.
+ */
+struct ectx_job {
+    int in_fd;
+    int in_w, in_h, in_stride, in_format;
+    int out_fd;
+    int out_w, out_h, out_stride, out_format;
+    int angle;
+    int x, y, w, h;
+    int scaler;     // same values as ectx_set_scaler()
+};
+
+/*
+ * Render count jobs with a single program bind and one flush at the end.
+ * Returns a fence like ectx_render_async().
+ */
+void *ectx_render_batch(void *_impl, const struct ectx_job *jobs, int count);
+
 #endif
 
@@ -1,133 +1,757 @@
+#include  <GLES3/gl3.h>
 #include  "anner_egl.h"
+#include  "anner_program.h"
+#include  "anner_effects.h"
+#include  "anner_hash.h"
+#include  "anner_source.h"
+#include  "anner_loader.h"
+#include  "anner_extension.h"
+#include  <libdrm/drm_fourcc.h>
 #include  <iostream>
 #include  <cstdlib>
 #include  <cstring>
 #include  <cmath>
+#include  <algorithm>
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include  <arm_neon.h>
+#elif defined(__SSE2__)
+#include  <emmintrin.h>
+#endif
 
 using namespace std; 
 
-const char vertex_src [] =
-      "#version 300 es                            \n"
-      "layout(location = 0) in vec4 a_position;   \n"
-      "layout(location = 1) in vec2 a_texCoord;   \n"
-      "out vec2 v_texCoord;                       \n"
-      "void main()                                \n"
-      "{                                          \n"
-      "   gl_Position = a_position;               \n"
-      "   v_texCoord = a_texCoord;                \n"
-      "}                                          \n";
- 
- 
-const char fragment_src [] =
-      "#version 300 es                                     \n"
-      "precision mediump float;                            \n"
-      "in vec2 v_texCoord;                                 \n"
-      "layout(location = 0) out vec4 outColor;             \n"
-      "uniform sampler2D s_texture;                        \n"
-      "void main()                                         \n"
-      "{                                                   \n"
-      "  outColor = texture( s_texture, v_texCoord );      \n"
-      "}                                                   \n";
-
 EGLDisplay  	egl_display;
 EGLContext  	egl_context;
 EGLSurface  	egl_surface;
 EGLConfig         ecfg;
 
-GLuint 		vertexShader;
-GLuint 		fragmentShader;
-GLuint 		shaderProgram;
-GLuint 		position_loc, textureId;
+GLuint 		textureId;
+
+static struct anner_program_cache programs;
+static GLuint quad_vbo;
 
 
 extern Window win;
 
-static GLuint load_shader ( const char  *shader_source, GLenum type){
-	GLuint  shader = glCreateShader( type );
-	glShaderSource  ( shader , 1 , &shader_source , NULL );
-	glCompileShader ( shader );
-	return shader;
+/*
+ * Streaming texture of the windowed upload path. Storage is allocated once
+ * per size/format, immutable where EXT_texture_storage (or ES 3.0) is
+ * available, and every frame only uploads into it with glTexSubImage2D, so
+ * the driver does not reallocate and re-validate a texture per frame.
+ */
+struct anner_stream_texture {
+	GLuint id;
+	int w;
+	int h;
+	int format;
+};
+
+static struct anner_stream_texture stream;
+static PFNGLTEXSTORAGE2DEXTPROC tex_storage_2d;
+
+/* Sized internal format for glTexStorage2D, 0 if the unsized format has none */
+static GLenum stream_sized_format(int format)
+{
+	switch (format) {
+	case GL_RGBA:
+		return GL_RGBA8_OES;
+	case GL_RGB:
+		return GL_RGB8_OES;
+	case GL_BGRA_EXT:
+		return GL_BGRA8_EXT;
+	default:
+		return 0;
+	}
 }
 
-void shader_init() {
+static void stream_texture_destroy(struct anner_stream_texture *tex)
+{
+	if (tex->id)
+		glDeleteTextures(1, &tex->id);
+	memset(tex, 0, sizeof(*tex));
+}
 
-	vertexShader   = load_shader ( vertex_src ,GL_VERTEX_SHADER);     // load vertex shader
-	fragmentShader = load_shader ( fragment_src ,GL_FRAGMENT_SHADER);  // load fragment shader
-	
-	shaderProgram  = glCreateProgram ();                 // create program object
-	glAttachShader ( shaderProgram, vertexShader );             // and attach both...
-	glAttachShader ( shaderProgram, fragmentShader );           // ... shaders to it
+static GLuint stream_texture_gen(void)
+{
+	GLuint id;
 
-	glLinkProgram(shaderProgram); 
-	glUseProgram(shaderProgram);
+	glGenTextures(1, &id);
+	glBindTexture(GL_TEXTURE_2D, id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	return id;
 }
 
-static GLuint CreateSimpleTexture2D(unsigned char* pixels, int w, int h, int format)
+static int stream_texture_alloc(struct anner_stream_texture *tex, int w, int h, int format)
 {
-   // Texture object handle
-   GLuint textureId;
+	GLenum sized = tex_storage_2d ? stream_sized_format(format) : 0;
+
+	stream_texture_destroy(tex);
+	tex->id = stream_texture_gen();
 
-   // Use tightly packed data
-   glPixelStorei ( GL_UNPACK_ALIGNMENT, 1 );
+	while (glGetError() != GL_NO_ERROR)
+		;
+	if (sized) {
+		tex_storage_2d(GL_TEXTURE_2D, 1, sized, w, h);
+		if (glGetError() != GL_NO_ERROR) {
+			// e.g. BGRA8 without storage support, immutable textures can not be respecified
+			glDeleteTextures(1, &tex->id);
+			tex->id = stream_texture_gen();
+			sized = 0;
+		}
+	}
+	if (!sized)
+		glTexImage2D(GL_TEXTURE_2D, 0, format, w, h, 0, format, GL_UNSIGNED_BYTE, NULL);
+	if (glGetError() != GL_NO_ERROR) {
+		cerr << "stream texture " << w << "x" << h << " format 0x" << hex << format << dec
+		     << " can not be allocated" << endl;
+		stream_texture_destroy(tex);
+		return -1;
+	}
+	tex->w = w;
+	tex->h = h;
+	tex->format = format;
+	return 0;
+}
 
-   // Generate a texture object
-   glGenTextures ( 1, &textureId );
-   
-   // Bind the texture object
-   glBindTexture ( GL_TEXTURE_2D, textureId );
+/* Bind the texture, (re)allocating it when the size or format changed */
+static int stream_texture_prepare(struct anner_stream_texture *tex, int w, int h, int format)
+{
+	if (!tex->id || tex->w != w || tex->h != h || tex->format != format)
+		return stream_texture_alloc(tex, w, h, format);
+	glBindTexture(GL_TEXTURE_2D, tex->id);
+	return 0;
+}
 
-   // Load the texture GL_BGRA_EXT 0x80E1
-   glTexImage2D ( GL_TEXTURE_2D, 0, format, w, h, 0, format, GL_UNSIGNED_BYTE, pixels);
-   //glTexImage2D ( GL_TEXTURE_2D, 0, GL_RGB, 2, 2, 0, GL_RGB, GL_UNSIGNED_BYTE, pixelss);
+/*
+ * GLES3 upload ring. Frames are written into one of a few pixel unpack
+ * buffers and the texture is updated from it, so glTexSubImage2D returns
+ * without copying client memory and the copy overlaps with drawing. A
+ * buffer is mapped unsynchronized and invalidated, its fence from the
+ * previous use guarantees the GPU is done reading it. The mapping can be
+ * filled by another thread between anner_map_texture() and
+ * anner_commit_texture(). Without GLES3 a client staging buffer stands in
+ * for the mapping, and anner_create_texture() uploads straight from the
+ * caller's pixels instead of copying them into it first.
+ */
+#define ANNER_UPLOAD_SLOTS 3
 
+struct anner_upload_slot {
+	GLuint pbo;
+	GLsync fence;
+	size_t size;
+};
 
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-   
-   return textureId;
+struct anner_upload_ring {
+	int gles3;
+	int next;
+	int mapped;         // slot handed out by anner_map_texture(), -1 when none
+	int w;
+	int h;
+	int format;
+	struct anner_upload_slot slots[ANNER_UPLOAD_SLOTS];
+	unsigned char *staging;
+	size_t staging_size;
+};
+
+static struct anner_upload_ring upload;
+
+static int upload_bytes_per_pixel(int format)
+{
+	return format == GL_RGB ? 3 : 4;
+}
+
+static void upload_ring_init(struct anner_upload_ring *ring)
+{
+	const char *version = (const char *)glGetString(GL_VERSION);
+
+	memset(ring, 0, sizeof(*ring));
+	ring->mapped = -1;
+	ring->gles3 = version && !strncmp(version, "OpenGL ES 3", 11);
+	for (int i = 0; ring->gles3 && i < ANNER_UPLOAD_SLOTS; i++) {
+		glGenBuffers(1, &ring->slots[i].pbo);
+	}
+	cerr << "upload ring: " << (ring->gles3 ? "pixel unpack buffers" : "client memory") << endl;
+}
+
+static void upload_ring_destroy(struct anner_upload_ring *ring)
+{
+	for (int i = 0; i < ANNER_UPLOAD_SLOTS; i++) {
+		if (ring->slots[i].fence)
+			glDeleteSync(ring->slots[i].fence);
+		if (ring->slots[i].pbo)
+			glDeleteBuffers(1, &ring->slots[i].pbo);
+	}
+	free(ring->staging);
+	memset(ring, 0, sizeof(*ring));
+	ring->mapped = -1;
+}
+
+static unsigned char *upload_ring_map(struct anner_upload_ring *ring, int w, int h, int format)
+{
+	size_t size = (size_t)w * h * upload_bytes_per_pixel(format);
+	struct anner_upload_slot *slot;
+	void *map;
+
+	if (ring->mapped >= 0)
+		return NULL;
+	ring->w = w;
+	ring->h = h;
+	ring->format = format;
+
+	if (!ring->gles3) {
+		if (ring->staging_size < size) {
+			free(ring->staging);
+			ring->staging = (unsigned char *)malloc(size);
+			ring->staging_size = ring->staging ? size : 0;
+		}
+		ring->mapped = ring->staging ? 0 : -1;
+		return ring->staging;
+	}
+
+	slot = &ring->slots[ring->next];
+	if (slot->fence) {
+		// normally long signaled, the ring is deeper than the frames in flight
+		glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		glDeleteSync(slot->fence);
+		slot->fence = 0;
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->pbo);
+	if (slot->size != size) {
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+		slot->size = size;
+	}
+	map = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT |
+	                       GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if (!map) {
+		cerr << "glMapBufferRange of " << size << " bytes failed" << endl;
+		return NULL;
+	}
+	ring->mapped = ring->next;
+	return (unsigned char *)map;
+}
+
+static int upload_ring_commit(struct anner_upload_ring *ring, struct anner_stream_texture *tex)
+{
+	struct anner_upload_slot *slot;
+	int ret;
+
+	if (ring->mapped < 0)
+		return -1;
+	ret = stream_texture_prepare(tex, ring->w, ring->h, ring->format);
+	// Use tightly packed data
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	if (!ring->gles3) {
+		if (ret == 0)
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, ring->w, ring->h, ring->format,
+			                GL_UNSIGNED_BYTE, ring->staging);
+		ring->mapped = -1;
+		return ret;
+	}
+
+	slot = &ring->slots[ring->mapped];
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->pbo);
+	if (!glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+		ret = -1;   // contents were lost, skip the frame
+	if (ret == 0) {
+		// offset 0 into the bound unpack buffer, the copy happens on the GPU timeline
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, ring->w, ring->h, ring->format,
+		                GL_UNSIGNED_BYTE, (const void *)0);
+		slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	ring->mapped = -1;
+	ring->next = (ring->next + 1) % ANNER_UPLOAD_SLOTS;
+	return ret;
+}
+
+/*
+ * Dirty tile upload. A shadow copy of the last uploaded frame is compared
+ * with the new one in 64x64 tiles, row by row through each band of tiles so
+ * the reads stay sequential. Only changed tiles are uploaded, horizontal
+ * runs of them in one glTexSubImage2D where GL_UNPACK_ROW_LENGTH exists
+ * (GLES3), whole bands of rows otherwise. The bounding box of the changed
+ * tiles is handed to the presenter as swap damage.
+ */
+#define ANNER_DIRTY_TILE 64
+
+struct anner_dirty_upload {
+	unsigned char *shadow;
+	unsigned char *band;    // changed tiles of the band being compared, one per tile column
+	size_t size;
+	int w;
+	int h;
+	int format;
+};
+
+/* Region of the texture changed by the last upload, in texture pixels */
+struct anner_damage {
+	int full;           // whole surface, also when the damage is unknown
+	int x, y, w, h;     // w == 0: nothing changed
+	int surface_w;      // viewport of the last present, a new one is damaged as a whole
+	int surface_h;
+};
+
+static struct anner_dirty_upload dirty;
+static struct anner_damage damage = { 1, 0, 0, 0, 0, 0, 0 };
+static PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC swap_with_damage;
+
+static int span_differs(const unsigned char *a, const unsigned char *b, size_t n)
+{
+	size_t i = 0;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	for (; i + 64 <= n; i += 64) {
+		uint8x16_t x = vorrq_u8(veorq_u8(vld1q_u8(a + i), vld1q_u8(b + i)),
+		                        veorq_u8(vld1q_u8(a + i + 16), vld1q_u8(b + i + 16)));
+		uint8x16_t y = vorrq_u8(veorq_u8(vld1q_u8(a + i + 32), vld1q_u8(b + i + 32)),
+		                        veorq_u8(vld1q_u8(a + i + 48), vld1q_u8(b + i + 48)));
+		uint64x2_t z = vreinterpretq_u64_u8(vorrq_u8(x, y));
+
+		if (vgetq_lane_u64(z, 0) | vgetq_lane_u64(z, 1))
+			return 1;
+	}
+#elif defined(__SSE2__)
+	for (; i + 64 <= n; i += 64) {
+		__m128i x = _mm_and_si128(
+			_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i)),
+			               _mm_loadu_si128((const __m128i *)(b + i))),
+			_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i + 16)),
+			               _mm_loadu_si128((const __m128i *)(b + i + 16))));
+		__m128i y = _mm_and_si128(
+			_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i + 32)),
+			               _mm_loadu_si128((const __m128i *)(b + i + 32))),
+			_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i + 48)),
+			               _mm_loadu_si128((const __m128i *)(b + i + 48))));
+
+		if (_mm_movemask_epi8(_mm_and_si128(x, y)) != 0xffff)
+			return 1;
+	}
+#endif
+	return memcmp(a + i, b + i, n - i) != 0;
+}
+
+static void damage_add(struct anner_damage *d, int x, int y, int w, int h)
+{
+	int x1, y1;
+
+	if (!d->w) {
+		d->x = x;
+		d->y = y;
+		d->w = w;
+		d->h = h;
+		return;
+	}
+	x1 = max(d->x + d->w, x + w);
+	y1 = max(d->y + d->h, y + h);
+	d->x = min(d->x, x);
+	d->y = min(d->y, y);
+	d->w = x1 - d->x;
+	d->h = y1 - d->y;
+}
+
+/* Upload rows [y, y + h) of the tiles marked in band, x in tiles */
+static void dirty_upload_band(const unsigned char *pixels, int w, int format, int bpp,
+                              int y, int h, const unsigned char *band, int tiles)
+{
+	if (!upload.gles3) {
+		// no GL_UNPACK_ROW_LENGTH, the rows of the band are contiguous in client memory
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, w, h, format, GL_UNSIGNED_BYTE,
+		                pixels + (size_t)y * w * bpp);
+		damage_add(&damage, 0, y, w, h);
+		return;
+	}
+	for (int tx = 0; tx < tiles; tx++) {
+		int end = tx;
+		int x, run;
+
+		if (!band[tx])
+			continue;
+		while (end + 1 < tiles && band[end + 1])
+			end++;
+		x = tx * ANNER_DIRTY_TILE;
+		run = min((end + 1) * ANNER_DIRTY_TILE, w) - x;
+		glPixelStorei(GL_UNPACK_SKIP_PIXELS, x);
+		glPixelStorei(GL_UNPACK_SKIP_ROWS, y);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, run, h, format, GL_UNSIGNED_BYTE, pixels);
+		damage_add(&damage, x, y, run, h);
+		tx = end;
+	}
+}
+
+static int dirty_upload(struct anner_dirty_upload *d, unsigned char *pixels, int w, int h, int format)
+{
+	int bpp = upload_bytes_per_pixel(format);
+	size_t size = (size_t)w * h * bpp;
+	size_t pitch = (size_t)w * bpp;
+	int tiles = (w + ANNER_DIRTY_TILE - 1) / ANNER_DIRTY_TILE;
+	unsigned char *band;
+
+	if (stream_texture_prepare(&stream, w, h, format) < 0)
+		return -1;
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	if (!d->shadow || !d->band || d->w != w || d->h != h || d->format != format) {
+		// first frame of this size, everything is new
+		free(d->shadow);
+		free(d->band);
+		d->shadow = (unsigned char *)malloc(size);
+		d->band = (unsigned char *)malloc(tiles);
+		d->size = d->shadow ? size : 0;
+		d->w = w;
+		d->h = h;
+		d->format = format;
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, format, GL_UNSIGNED_BYTE, pixels);
+		if (d->shadow)
+			memcpy(d->shadow, pixels, size);
+		damage.full = 1;
+		return 0;
+	}
+
+	band = d->band;
+	damage.full = 0;
+	damage.w = 0;
+	if (upload.gles3)
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, w);
+	for (int y = 0; y < h; y += ANNER_DIRTY_TILE) {
+		int rows = min(ANNER_DIRTY_TILE, h - y);
+		int any = 0;
+
+		memset(band, 0, tiles);
+		for (int r = y; r < y + rows; r++) {
+			const unsigned char *src = pixels + r * pitch;
+			const unsigned char *old = d->shadow + r * pitch;
+
+			for (int tx = 0; tx < tiles; tx++) {
+				size_t x = (size_t)tx * ANNER_DIRTY_TILE * bpp;
+
+				if (!band[tx] && span_differs(src + x, old + x, min(pitch - x, (size_t)ANNER_DIRTY_TILE * bpp)))
+					band[tx] = any = 1;
+			}
+		}
+		if (!any)
+			continue;
+		for (int r = y; r < y + rows; r++) {
+			for (int tx = 0; tx < tiles; tx++) {
+				size_t x = (size_t)tx * ANNER_DIRTY_TILE * bpp;
+
+				if (band[tx])
+					memcpy(d->shadow + r * pitch + x, pixels + r * pitch + x,
+					       min(pitch - x, (size_t)ANNER_DIRTY_TILE * bpp));
+			}
+		}
+		dirty_upload_band(pixels, w, format, bpp, y, rows, band, tiles);
+	}
+	if (upload.gles3) {
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+		glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+	}
+	return 0;
+}
+
+static void dirty_upload_destroy(struct anner_dirty_upload *d)
+{
+	free(d->shadow);
+	free(d->band);
+	memset(d, 0, sizeof(*d));
+}
+
+void shader_init() {
+	const struct anner_program *prog;
+	struct anner_transform transform;
+	GLfloat matrix[9], clip[4];
+	const char *extensions;
+
+	anner_program_cache_init(&programs);
+	// compile the default variant up front so the first frame does not pay for it
+	prog = anner_program_use(&programs, ANNER_PROGRAM_KEY(ANNER_PROGRAM_FORMAT_RGB,
+	                                                      ANNER_PROGRAM_SAMPLER_2D,
+	                                                      ANNER_PROGRAM_EFFECT_NONE,
+	                                                      ANNER_PROGRAM_FILTER_DIRECT));
+	if (prog) {
+		// client memory starts with the top row, the window origin is bottom left
+		anner_transform_init(&transform);
+		transform.flip_v = 1;
+		anner_transform_matrix(&transform, 1, 1, matrix, clip);
+		anner_program_set_transform(prog, matrix, clip);
+	}
+	quad_vbo = anner_quad_create();
+	upload_ring_init(&upload);
+	extensions = eglQueryString(egl_display, EGL_EXTENSIONS);
+	if (anner_has_extension(extensions, "EGL_KHR_swap_buffers_with_damage"))
+		swap_with_damage = (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC) eglGetProcAddress("eglSwapBuffersWithDamageKHR");
+	else if (anner_has_extension(extensions, "EGL_EXT_swap_buffers_with_damage"))
+		swap_with_damage = (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC) eglGetProcAddress("eglSwapBuffersWithDamageEXT");
+	// eglGetProcAddress() may hand out entry points the context does not support
+	if (anner_has_extension((const char *)glGetString(GL_EXTENSIONS), "GL_EXT_texture_storage"))
+		tex_storage_2d = (PFNGLTEXSTORAGE2DEXTPROC) eglGetProcAddress("glTexStorage2DEXT");
+	else if (upload.gles3)
+		tex_storage_2d = (PFNGLTEXSTORAGE2DEXTPROC) eglGetProcAddress("glTexStorage2D");
+}
+
+void shader_deinit() {
+	dirty_upload_destroy(&dirty);
+	upload_ring_destroy(&upload);
+	stream_texture_destroy(&stream);
+	textureId = 0;
+	anner_quad_destroy(quad_vbo);
+	anner_program_cache_destroy(&programs);
+}
+
+/*
+ * Frame deduplication. With it enabled anner_create_texture() hashes every
+ * frame, and one equal to the frame already in the texture is neither
+ * uploaded nor drawn again: egl_render() leaves the last present on screen
+ * and counts the frame as skipped.
+ */
+struct anner_dedup {
+	int enable;
+	int valid;          // hash describes the texture content
+	int repeat;         // the last upload was skipped
+	uint64_t hash;
+	uint64_t skipped;
+};
+
+static struct anner_dedup dedup;
+
+void anner_set_dedup(int enable) {
+	dedup.enable = enable;
+	dedup.valid = 0;
+	dedup.repeat = 0;
+}
+
+uint64_t anner_get_skipped_frames(void) {
+	return dedup.skipped;
+}
+
+/* The whole texture is about to be replaced */
+static void stream_replace(void)
+{
+	// the shadow copy and the frame hash no longer match the texture
+	dirty_upload_destroy(&dirty);
+	dedup.valid = 0;
+	dedup.repeat = 0;
+	damage.full = 1;
+}
+
+unsigned char* anner_map_texture(int w, int h, int format) {
+	return upload_ring_map(&upload, w, h, format);
+}
+
+int anner_commit_texture(void) {
+	stream_replace();
+	if (upload_ring_commit(&upload, &stream) < 0)
+		return -1;
+	textureId = stream.id;
+	return 0;
+}
+
+int anner_update_texture(unsigned char* pixels, int w, int h, int format) {
+	// unchanged tiles are skipped here already
+	dedup.valid = 0;
+	dedup.repeat = 0;
+	if (dirty_upload(&dirty, pixels, w, h, format) < 0)
+		return -1;
+	textureId = stream.id;
+	return 0;
 }
 
 int anner_create_texture(unsigned char* pixels, int w, int h, int format) {
-	textureId 	  = CreateSimpleTexture2D(pixels, w, h, format);
-	position_loc  = glGetUniformLocation  (shaderProgram, "s_texture" );
+	size_t size = (size_t)w * h * upload_bytes_per_pixel(format);
+	unsigned char *map;
+	uint64_t hash = 0;
+
+	if (dedup.enable) {
+		int shape[3] = { w, h, format };
+
+		hash = anner_hash64(pixels, size, anner_hash64(shape, sizeof(shape), 0));
+		if (dedup.valid && dedup.hash == hash && stream.id) {
+			dedup.repeat = 1;
+			return 0;
+		}
+	}
+	if (!upload.gles3) {
+		// no unpack buffer to fill, going through staging would only add a copy
+		stream_replace();
+		if (stream_texture_prepare(&stream, w, h, format) < 0)
+			return -1;
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, format, GL_UNSIGNED_BYTE, pixels);
+		textureId = stream.id;
+	} else {
+		map = anner_map_texture(w, h, format);
+		if (!map)
+			return -1;
+		memcpy(map, pixels, size);
+		if (anner_commit_texture() < 0)
+			return -1;
+	}
+	dedup.hash = hash;
+	dedup.valid = dedup.enable;
 	return 0;
 }
 
+/* GL upload format of a packed RGB fourcc, 0 if the window path can not show it */
+static int source_gl_format(uint32_t format)
+{
+	switch (format) {
+	case DRM_FORMAT_ARGB8888:
+	case DRM_FORMAT_XRGB8888:
+		return GL_BGRA_EXT;
+	case DRM_FORMAT_ABGR8888:
+	case DRM_FORMAT_XBGR8888:
+		return GL_RGBA;
+	case DRM_FORMAT_BGR888:
+		return GL_RGB;
+	default:
+		return 0;
+	}
+}
+
+int anner_upload_frame(void* frames, int index) {
+	struct anner_source *source = (struct anner_source *)frames;
+	const unsigned char *frame;
+	int format;
+
+	if (!source)
+		return -1;
+	format = source_gl_format(source->format);
+	if (!format || source->layout.pitches[0] != source->w * upload_bytes_per_pixel(format)) {
+		cerr << "anner_upload_frame: only packed RGB frames can be uploaded" << endl;
+		return -1;
+	}
+	frame = anner_source_frame(source, index);
+	if (!frame)
+		return -1;
+	// the mapping is read-only, the upload only reads it
+	return anner_create_texture((unsigned char *)frame, source->w, source->h, format);
+}
+
+/* Loader filling plain staging memory, uploaded through anner_create_texture() */
+struct staging_loader {
+	struct anner_loader loader;
+	void *staging[ANNER_LOADER_MAX];
+	int count;
+	int format;
+};
+
+void anner_stop_loader(void* loader) {
+	struct staging_loader *l = (struct staging_loader *)loader;
+
+	if (!l)
+		return;
+	anner_loader_destroy(&l->loader);
+	for (int i = 0; i < l->count; i++)
+		free(l->staging[i]);
+	free(l);
+}
+
+void* anner_start_loader(void* frames, int threads, int count) {
+	struct anner_source *source = (struct anner_source *)frames;
+	struct anner_loader_buffer buffers[ANNER_LOADER_MAX];
+	struct staging_loader *l;
+
+	if (!source || count < 1 || count > ANNER_LOADER_MAX)
+		return NULL;
+	l = (struct staging_loader *)calloc(1, sizeof(*l));
+	if (!l)
+		return NULL;
+	l->format = source_gl_format(source->format);
+	if (!l->format) {
+		cerr << "anner_start_loader: only RGB frames can be uploaded" << endl;
+		free(l);
+		return NULL;
+	}
+	for (; l->count < count; l->count++) {
+		l->staging[l->count] = malloc(source->layout.size);
+		if (!l->staging[l->count])
+			break;
+		// packed rows, as anner_create_texture() expects them
+		buffers[l->count].data = l->staging[l->count];
+		buffers[l->count].stride = source->w * upload_bytes_per_pixel(l->format);
+		buffers[l->count].fd = -1;
+		buffers[l->count].begin_cpu = NULL;
+		buffers[l->count].end_cpu = NULL;
+	}
+	if (l->count < count ||
+	    anner_loader_init(&l->loader, source, threads, buffers, count) < 0) {
+		anner_stop_loader(l);
+		return NULL;
+	}
+	return l;
+}
+
+int anner_upload_loaded(void* loader, int timeout_ms) {
+	struct staging_loader *l = (struct staging_loader *)loader;
+	int frame;
+	int slot;
+	int ret;
+
+	if (!l)
+		return -1;
+	slot = anner_loader_acquire(&l->loader, timeout_ms, &frame);
+	if (slot < 0)
+		return -1;
+	// the upload copies the frame, the slot can be refilled right away
+	ret = anner_create_texture((unsigned char *)l->staging[slot], l->loader.source->w,
+	                           l->loader.source->h, l->format);
+	anner_loader_release(&l->loader, slot);
+	return ret < 0 ? -1 : frame;
+}
+
 int anner_delete_texture() {
-	glDeleteTextures(1, &textureId);
+	dirty_upload_destroy(&dirty);
+	dedup.valid = 0;
+	dedup.repeat = 0;
+	stream_texture_destroy(&stream);
+	textureId = 0;
 	return 0;
 }
 
 int egl_render(int w, int h) {
 
-	//正常贴图
-   	GLfloat vVertices[] = { -1.0f,  1.0f, 0.0f,  // Position 0
-                            0.0f,  0.0f,        // TexCoord 0 
-                           -1.0f, -1.0f, 0.0f,  // Position 1
-                            0.0f,  1.0f,        // TexCoord 1
-                            1.0f, -1.0f, 0.0f,  // Position 2
-                            1.0f,  1.0f,        // TexCoord 2
-                            1.0f,  1.0f, 0.0f,  // Position 3
-                            1.0f,  0.0f         // TexCoord 3
-                         };
-    GLushort indices[] = { 0, 1, 2, 0, 2, 3 };
-
+	if (dedup.repeat && damage.surface_w == w && damage.surface_h == h) {
+		dedup.repeat = 0;
+		dedup.skipped++;
+		return 0;
+	}
+	dedup.repeat = 0;
+	if (!anner_program_use(&programs, ANNER_PROGRAM_KEY(ANNER_PROGRAM_FORMAT_RGB,
+	                                                    ANNER_PROGRAM_SAMPLER_2D,
+	                                                    ANNER_PROGRAM_EFFECT_NONE,
+	                                                    ANNER_PROGRAM_FILTER_DIRECT))) {
+		cerr << "Could not set up graphics." << endl;
+		return -1;
+	}
 	glViewport(0, 0, w, h);
 	glClear ( GL_COLOR_BUFFER_BIT );
-   	glVertexAttribPointer ( 0, 3, GL_FLOAT,
-                           GL_FALSE, 5 * sizeof ( GLfloat ), vVertices );
-
-   	glVertexAttribPointer ( 1, 2, GL_FLOAT,
-                           GL_FALSE, 5 * sizeof ( GLfloat ), &vVertices[3] );
-   	glEnableVertexAttribArray (0);
-   	glEnableVertexAttribArray (1);
    	glActiveTexture ( GL_TEXTURE0 );
    	glBindTexture ( GL_TEXTURE_2D, textureId );
-   	// Set the sampler texture unit to 0
-   	glUniform1i (position_loc, 0);
       //glReadPixels
 
-   	glDrawElements (GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, indices );
-   	eglSwapBuffers ( egl_display, egl_surface );
+   	anner_quad_draw(quad_vbo);
+   	if (!swap_with_damage || damage.full || !stream.w || !stream.h ||
+   	    damage.surface_w != w || damage.surface_h != h) {
+   		eglSwapBuffers ( egl_display, egl_surface );
+   	} else {
+   		// texture rows run top down, EGL damage is bottom up; round outwards
+   		int x0 = damage.x * w / stream.w;
+   		int x1 = ((damage.x + damage.w) * w + stream.w - 1) / stream.w;
+   		int y0 = damage.y * h / stream.h;
+   		int y1 = ((damage.y + damage.h) * h + stream.h - 1) / stream.h;
+   		EGLint rect[4] = { x0, h - y1, x1 - x0, y1 - y0 };
+
+   		if (!damage.w)
+   			rect[2] = rect[3] = 0;   // an empty rect, no rect at all would mean the whole surface
+   		swap_with_damage(egl_display, egl_surface, rect, 1);
+   	}
+   	// presenting the same frame again changes nothing
+   	damage.surface_w = w;
+   	damage.surface_h = h;
+   	damage.full = !dirty.shadow;
+   	damage.w = 0;
    	return 0;
 }
\ No newline at end of file
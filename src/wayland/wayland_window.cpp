@@ -767,6 +767,7 @@ void anner_create_window(int window_width, int window_height) {
 }
 
 void anner_destory_window() {
+	shader_deinit();
 	destroy_surface(&window);
 	fini_egl(&display);
 
@@ -18,6 +18,7 @@ extern EGLContext  	egl_context;
 extern EGLSurface  	egl_surface;
 extern EGLConfig       ecfg;
 extern void shader_init();
+extern void shader_deinit();
 
 Display    *x_display;
 Window      win;
@@ -182,6 +183,7 @@ int egl_deinit_x11() {
 
 void anner_destory_window() {
 	quit = true;
+	shader_deinit();
 	egl_deinit_x11();
 	x_deinit();
 }